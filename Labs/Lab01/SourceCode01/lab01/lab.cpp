@@ -11,6 +11,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/gl_state.h>
 
 using namespace std;
 
@@ -49,7 +50,7 @@ void createContext() {
 
     // task define VAO
     glGenVertexArrays(1, &triangleVAO);
-    glBindVertexArray(triangleVAO);
+    GLState::bindVertexArray(triangleVAO);
 
     // task define vertex VBO
 	glGenBuffers(1, &verticesVBO);
@@ -84,8 +85,10 @@ void free() {
     // Free allocated buffers
     glDeleteBuffers(1, &verticesVBO);
     glDeleteBuffers(1, &colorsVBO);
-    glDeleteVertexArrays(1, &triangleVAO);
-    glDeleteProgram(shaderProgram);
+    GLState::deleteVertexArrays(1, &triangleVAO);
+    GLState::deleteProgram(shaderProgram);
+
+    GLState::printReport();
 
     // Close OpenGL window and terminate GLFW
     glfwTerminate();
@@ -98,10 +101,10 @@ void mainLoop() {
 
         // Draw
         // task bind shader
-        glUseProgram(shaderProgram);
+        GLState::useProgram(shaderProgram);
 
         // task bind VAO
-        glBindVertexArray(triangleVAO);
+        GLState::bindVertexArray(triangleVAO);
 
         // task draw triangle
         glDrawArrays(GL_TRIANGLES, 0, 3);
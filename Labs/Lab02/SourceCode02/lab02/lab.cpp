@@ -16,6 +16,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/gl_state.h>
 
 using namespace std;
 using namespace glm;
@@ -48,7 +49,7 @@ void createContext() {
     // --- Setting up the triangle ---
     // Generate and bind a Vertex Array Object (VAO) for the triangle
     glGenVertexArrays(1, &triangleVAO);
-    glBindVertexArray(triangleVAO);
+    GLState::bindVertexArray(triangleVAO);
 
     // Define the vertex positions for the triangle
     static const GLfloat triangleVertices[] = {
@@ -82,7 +83,7 @@ void createContext() {
 
     // --- Setting up the cube ---
     glGenVertexArrays(1, &cubeVAO);
-    glBindVertexArray(cubeVAO);
+    GLState::bindVertexArray(cubeVAO);
 
     // Our vertices. Three consecutive floats give a 3D vertex; Three
     // consecutive vertices give a triangle. A cube has 6 faces with 2
@@ -193,11 +194,13 @@ void createContext() {
 void free() {
     glDeleteBuffers(1, &triangleVerticiesVBO);
     glDeleteBuffers(1, &triangleColorsVBO);
-    glDeleteVertexArrays(1, &triangleVAO);
+    GLState::deleteVertexArrays(1, &triangleVAO);
     glDeleteBuffers(1, &cubeVerticiesVBO);
     glDeleteBuffers(1, &cubeColorsVBO);
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteProgram(shaderProgram);
+    GLState::deleteVertexArrays(1, &cubeVAO);
+    GLState::deleteProgram(shaderProgram);
+
+    GLState::printReport();
 
     glfwTerminate();
 }
@@ -249,7 +252,7 @@ void mainLoop() {
         //MVP = Proj * View * Model;
         
         // Define the active shader program
-        glUseProgram(shaderProgram);
+        GLState::useProgram(shaderProgram);
         
         // Pass the MVP matrix to the shader as a uniform variable
         glUniformMatrix4fv(MVPLocation, 1, GL_FALSE, &MVP[0][0]); // Του λέμε να ψάξει στην MVP μεταβλητή!
@@ -258,7 +261,7 @@ void mainLoop() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         // Bind the triangle VAO (so OpenGL knows which object to render)
-        glBindVertexArray(triangleVAO);
+        GLState::bindVertexArray(triangleVAO);
         
         // Draw the triangle
         glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -266,7 +269,7 @@ void mainLoop() {
         // Optional: You can uncomment the following lines to render a cube as well
 
         // Bind the cube VAO
-        glBindVertexArray(cubeVAO);
+        GLState::bindVertexArray(cubeVAO);
 
         mat4 ModelCube = mat4();
 
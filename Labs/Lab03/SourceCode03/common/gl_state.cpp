@@ -0,0 +1,153 @@
+#include <iostream>
+#include "gl_state.h"
+
+using namespace std;
+
+// texture units and targets with a shadow, others are always issued
+#define TRACKED_UNITS 32
+#define TRACKED_TARGETS 3
+
+// a binding that isn't known, so the next bind is issued
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+static GLuint program = UNKNOWN;
+static GLuint vao = UNKNOWN;
+static GLuint drawFramebuffer = UNKNOWN, readFramebuffer = UNKNOWN;
+static GLuint activeUnit = UNKNOWN; // index, not GL_TEXTUREi
+static GLuint textures[TRACKED_UNITS][TRACKED_TARGETS];
+static bool texturesInitialized = false;
+
+static GLState::Stats frameStats = {0, 0};
+static GLState::Stats previousFrameStats = {0, 0};
+static GLState::Stats totalStats = {0, 0};
+
+static void issued() {
+    frameStats.issued++;
+    totalStats.issued++;
+}
+
+static void skipped() {
+    frameStats.skipped++;
+    totalStats.skipped++;
+}
+
+static int targetIndex(GLenum target) {
+    switch (target) {
+    case GL_TEXTURE_2D: return 0;
+    case GL_TEXTURE_2D_ARRAY: return 1;
+    case GL_TEXTURE_CUBE_MAP: return 2;
+    default: return -1;
+    }
+}
+
+// the shadow of `target` on `unit`, nullptr if it isn't tracked
+static GLuint* textureBinding(GLuint unit, GLenum target) {
+    if (!texturesInitialized) GLState::invalidate();
+    int index = targetIndex(target);
+    if (unit >= TRACKED_UNITS || index < 0) return nullptr;
+    return &textures[unit][index];
+}
+
+void GLState::useProgram(GLuint id) {
+    if (id == program) return skipped();
+    glUseProgram(id);
+    program = id;
+    issued();
+}
+
+void GLState::bindVertexArray(GLuint id) {
+    if (id == vao) return skipped();
+    glBindVertexArray(id);
+    vao = id;
+    issued();
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint id) {
+    bool draw = target != GL_READ_FRAMEBUFFER;
+    bool read = target != GL_DRAW_FRAMEBUFFER;
+    if ((!draw || id == drawFramebuffer) && (!read || id == readFramebuffer)) return skipped();
+    glBindFramebuffer(target, id);
+    if (draw) drawFramebuffer = id;
+    if (read) readFramebuffer = id;
+    issued();
+}
+
+void GLState::activeTexture(GLenum unit) {
+    GLuint index = unit - GL_TEXTURE0;
+    if (index == activeUnit) return skipped();
+    glActiveTexture(unit);
+    activeUnit = index;
+    issued();
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture) {
+    // any unit will do, but it has to be known to keep its shadow
+    if (activeUnit == UNKNOWN) activeTexture(GL_TEXTURE0);
+    GLuint* bound = textureBinding(activeUnit, target);
+    if (bound && *bound == texture) return skipped();
+    glBindTexture(target, texture);
+    if (bound) *bound = texture;
+    issued();
+}
+
+void GLState::bindTexture(GLenum unit, GLenum target, GLuint texture) {
+    GLuint* bound = textureBinding(unit - GL_TEXTURE0, target);
+    if (bound && *bound == texture) return skipped();
+    activeTexture(unit);
+    bindTexture(target, texture);
+}
+
+void GLState::deleteProgram(GLuint id) {
+    glDeleteProgram(id);
+    if (id == program) program = UNKNOWN;
+}
+
+void GLState::deleteVertexArrays(GLsizei n, const GLuint* ids) {
+    glDeleteVertexArrays(n, ids);
+    // GL reverts the bindings of deleted objects to 0
+    for (GLsizei i = 0; i < n; i++) {
+        if (ids[i] == vao) vao = 0;
+    }
+}
+
+void GLState::deleteTextures(GLsizei n, const GLuint* ids) {
+    glDeleteTextures(n, ids);
+    if (!texturesInitialized) invalidate();
+    for (GLsizei i = 0; i < n; i++) {
+        for (auto& unit : textures) {
+            for (GLuint& bound : unit) {
+                if (bound == ids[i]) bound = 0;
+            }
+        }
+    }
+}
+
+void GLState::deleteFramebuffers(GLsizei n, const GLuint* ids) {
+    glDeleteFramebuffers(n, ids);
+    for (GLsizei i = 0; i < n; i++) {
+        if (ids[i] == drawFramebuffer) drawFramebuffer = 0;
+        if (ids[i] == readFramebuffer) readFramebuffer = 0;
+    }
+}
+
+void GLState::invalidate() {
+    program = vao = drawFramebuffer = readFramebuffer = activeUnit = UNKNOWN;
+    for (auto& unit : textures) {
+        for (GLuint& bound : unit) bound = UNKNOWN;
+    }
+    texturesInitialized = true;
+}
+
+void GLState::endFrame() {
+    previousFrameStats = frameStats;
+    frameStats.issued = frameStats.skipped = 0;
+}
+
+GLState::Stats GLState::lastFrameStats() {
+    return previousFrameStats;
+}
+
+void GLState::printReport() {
+    cout << "GL state: " << totalStats.issued << " binds issued, "
+         << totalStats.skipped << " skipped" << endl;
+}
@@ -7,6 +7,7 @@
 #include "util.h"
 #include "model.h"
 #include "texture.h"
+#include "gl_state.h"
 
 using namespace glm;
 using namespace std;
@@ -351,7 +352,7 @@ Drawable::~Drawable() {
 }
 
 void Drawable::bind() {
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 }
 
 void Drawable::draw(int mode) {
@@ -363,7 +364,7 @@ void Drawable::createContext() {
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
 
     glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 
     glGenBuffers(1, &verticesVBO);
     glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
@@ -427,11 +428,11 @@ Mesh::~Mesh() {
     glDeleteBuffers(1, &uvsVBO);
     glDeleteBuffers(1, &normalsVBO);
     glDeleteBuffers(1, &elementVBO);
-    glDeleteVertexArrays(1, &VAO);
+    GLState::deleteVertexArrays(1, &VAO);
 }
 
 void Mesh::bind() {
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 }
 
 void Mesh::draw(int mode) {
@@ -443,7 +444,7 @@ void Mesh::createContext() {
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
 
     glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 
     glGenBuffers(1, &verticesVBO);
     glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
@@ -488,7 +489,7 @@ Model::Model(string path, Model::MTLUploadFunction* uploader)
 
 Model::~Model() {
     for (const auto& t : textures) {
-        glDeleteTextures(1, &t.second);
+        GLState::deleteTextures(1, &t.second);
     }
 }
 
@@ -16,6 +16,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/gl_state.h>
 #include <common/camera.h>
 #include <common/model.h>
 #include <common/texture.h>
@@ -66,7 +67,7 @@ void createContext() {
 
     // VAO
     glGenVertexArrays(1, &suzanneVAO);
-    glBindVertexArray(suzanneVAO);
+    GLState::bindVertexArray(suzanneVAO);
 
     // vertex VBO
     glGenBuffers(1, &suzanneVerticiesVBO);
@@ -123,11 +124,14 @@ void createContext() {
 void free() {
     glDeleteBuffers(1, &suzanneVerticiesVBO);
     glDeleteBuffers(1, &suzanneUVVBO);
-    glDeleteTextures(1, &texture);
-    glDeleteTextures(1, &movingTexture);
-    glDeleteTextures(1, &displacementTexture);
-    glDeleteVertexArrays(1, &suzanneVAO);
-    glDeleteProgram(shaderProgram);
+    GLState::deleteTextures(1, &texture);
+    GLState::deleteTextures(1, &movingTexture);
+    GLState::deleteTextures(1, &displacementTexture);
+    GLState::deleteVertexArrays(1, &suzanneVAO);
+    GLState::deleteProgram(shaderProgram);
+
+    GLState::printReport();
+
     glfwTerminate();
 }
 
@@ -140,10 +144,10 @@ void mainLoop() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Use the shader program for rendering
-        glUseProgram(shaderProgram);
+        GLState::useProgram(shaderProgram);
 
         // Bind the Vertex Array Object (VAO) for the model to be drawn (e.g., 'suzanne')
-        glBindVertexArray(suzanneVAO);
+        GLState::bindVertexArray(suzanneVAO);
 
         // Task 5: Camera updates for movement and orientation
         camera->update(); // Update the camera based on user input
@@ -175,18 +179,15 @@ void mainLoop() {
         
         // Task 6: texture
         // Bind our texture in Texture Unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, texture);
         // Set our "textureSampler" sampler to use Texture Unit 0
         glUniform1i(textureSampler, 0);
 
 
 
         // Task 7: moving water/fire texture
-        // Activate texture1
-        glActiveTexture(GL_TEXTURE1);
-        // Bind our texture in the currently active texture unit (which now is 1)
-        glBindTexture(GL_TEXTURE_2D, movingTexture);
+        // Bind our texture in Texture Unit 1
+        GLState::bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, movingTexture);
         // Set our "textureSampler" sampler to use Texture Unit 1
         glUniform1i(movingTextureSampler, 1);
         // Pass time to shader
@@ -195,11 +196,9 @@ void mainLoop() {
 
          
         // Task 8: displacement texture
-        // Activate texture1
-        glActiveTexture(GL_TEXTURE2);
-        // Bind our texture in the currently active texture unit (which now is 1)
-        glBindTexture(GL_TEXTURE_2D, displacementTexture);
-        // Set our "textureSampler" sampler to use Texture Unit 1
+        // Bind our texture in Texture Unit 2
+        GLState::bindTexture(GL_TEXTURE2, GL_TEXTURE_2D, displacementTexture);
+        // Set our "textureSampler" sampler to use Texture Unit 2
         glUniform1i(displacementTextureSampler, 2);
 
 
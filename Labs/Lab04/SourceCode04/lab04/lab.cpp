@@ -16,6 +16,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/gl_state.h>
 #include <common/camera.h>
 #include <common/model.h>
 #include <common/texture.h>
@@ -133,13 +134,15 @@ void createContext() {
 }
 void free() {
     glDeleteBuffers(1, &modelVerticiesVBO);
-    glDeleteVertexArrays(1, &modelVAO);
+    GLState::deleteVertexArrays(1, &modelVAO);
 
     glDeleteBuffers(1, &planeVerticiesVBO);
-    glDeleteVertexArrays(1, &planeVAO);
+    GLState::deleteVertexArrays(1, &planeVAO);
 
-    glDeleteProgram(shaderProgram);
-    glDeleteProgram(plane2ShaderProgram);
+    GLState::deleteProgram(shaderProgram);
+    GLState::deleteProgram(plane2ShaderProgram);
+
+    GLState::printReport();
 
     glfwTerminate();
 }
@@ -154,7 +157,7 @@ void mainLoop() {
         mat4 viewMatrix       = camera->viewMatrix;
 
         // Homework 2 - Create a red second plane
-        glUseProgram(plane2ShaderProgram);
+        GLState::useProgram(plane2ShaderProgram);
 
 		plane2->bind();
 		vec3 plane2Position(0, plane2Y, 0);
@@ -167,7 +170,7 @@ void mainLoop() {
 		glUniformMatrix4fv(plane2MLocation,  1, GL_FALSE, &plane2ModelMatrix[0][0]);
 		plane2->draw(); // Task 5.3: Render the plane using the new shader program
 
-        glUseProgram(shaderProgram); // Original shader used during the lab...
+        GLState::useProgram(shaderProgram); // Original shader used during the lab...
 
 		vec3 plane2Normal(plane2Rotation * vec4(0, 1, 0, 0));
 		float d2 = -dot(plane2Normal, plane2Position);
@@ -0,0 +1,49 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+#include <cstddef>
+
+/**
+* A shadow of the current program, vertex array, texture and framebuffer
+* bindings that drops calls which would bind what is already bound. All of
+* these binds have to go through it (GL thread only), otherwise the shadow
+* goes stale; after code that binds on its own (e.g. SOIL) call invalidate().
+* Deleted objects must be deleted through it as well, GL reuses their names.
+*/
+class GLState {
+public:
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vao);
+    static void bindFramebuffer(GLenum target, GLuint framebuffer);
+
+    /**
+    * Binds `texture` to `unit` (GL_TEXTUREi) for drawing. The active unit
+    * is only switched if the binding changes, so use the two argument
+    * version before changing the texture itself.
+    */
+    static void bindTexture(GLenum unit, GLenum target, GLuint texture);
+    /* Like glActiveTexture and glBindTexture, for creating and editing textures */
+    static void activeTexture(GLenum unit);
+    static void bindTexture(GLenum target, GLuint texture);
+
+    static void deleteProgram(GLuint program);
+    static void deleteVertexArrays(GLsizei n, const GLuint* vaos);
+    static void deleteTextures(GLsizei n, const GLuint* textures);
+    static void deleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+
+    /* Forgets every binding, the next bind of each is always issued */
+    static void invalidate();
+
+    /* Calls issued and skipped as redundant */
+    struct Stats {
+        size_t issued, skipped;
+    };
+    /* Ends a frame: its counts become lastFrameStats() and restart at 0 */
+    static void endFrame();
+    static Stats lastFrameStats();
+    /* Prints the calls issued and skipped since the start */
+    static void printReport();
+};
+
+#endif
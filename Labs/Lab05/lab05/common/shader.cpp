@@ -1,4 +1,5 @@
 #include <GL/glew.h>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -7,7 +8,7 @@ using namespace std;
 
 #include "shader.h"
 
-void compileShader(GLuint& shaderID, const char* file) {
+std::string readShaderSource(const char* file) {
     // read shader code from the file
     std::string shaderCode;
     std::ifstream shaderStream(file, std::ios::in);
@@ -20,76 +21,131 @@ void compileShader(GLuint& shaderID, const char* file) {
     } else {
         throw runtime_error(string("Can't open shader file: ") + file);
     }
+    return shaderCode;
+}
 
-    GLint result = GL_FALSE;
-    int infoLogLength;
-
-    // compile Vertex Shader
+// starts the compile, checkShader() waits for it
+static void submitShader(GLuint shaderID, const char* file, const std::string& shaderCode) {
     cout << "Compiling shader: " << file << endl;
     char const* sourcePointer = shaderCode.c_str();
     glShaderSource(shaderID, 1, &sourcePointer, NULL);
     glCompileShader(shaderID);
+}
 
-    // check Vertex Shader
+static void checkShader(GLuint shaderID, const std::string& file) {
+    GLint result = GL_FALSE;
+    int infoLogLength;
+
+    // check the shader
     glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
     glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
     if (infoLogLength > 0) {
         std::vector<char> shaderErrorMessage(infoLogLength + 1);
         glGetShaderInfoLog(shaderID, infoLogLength, NULL, &shaderErrorMessage[0]);
         //throw runtime_error(string(&shaderErrorMessage[0]));
-        cout << &shaderErrorMessage[0] << endl;
+        cout << file << ": " << &shaderErrorMessage[0] << endl;
     }
 }
 
-GLuint loadShaders(const char* vertexFilePath,
-                   const char* fragmentFilePath,
-                   const char* geometryFilePath) {
-    // Create the shaders
-    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    compileShader(vertexShaderID, vertexFilePath);
+static bool parallelCompileSupported() {
+    static int supported = -1;
+    if (supported < 0) {
+        supported = GLEW_ARB_parallel_shader_compile ? 1 : 0;
+        GLint extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions && !supported; i++) {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && strcmp(name, "GL_KHR_parallel_shader_compile") == 0) supported = 1;
+        }
+        // let the driver pick the number of compiler threads
+        if (GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+    return supported == 1;
+}
 
-    GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-    compileShader(fragmentShaderID, fragmentFilePath);
+ShaderBatch::ShaderBatch() {
+    parallelCompileSupported();
+}
 
-    GLuint geometryShaderID = 0;
-    if (geometryFilePath) {
-        geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
-        compileShader(geometryShaderID, geometryFilePath);
+ShaderBatch::~ShaderBatch() {
+    finish();
+}
+
+GLuint ShaderBatch::add(const char* vertexFilePath,
+                        const char* fragmentFilePath,
+                        const char* geometryFilePath) {
+    Pending p;
+    p.files.push_back(vertexFilePath);
+    p.files.push_back(fragmentFilePath);
+    if (geometryFilePath) p.files.push_back(geometryFilePath);
+
+    // Create the shaders, in the order of p.files
+    GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER};
+    for (size_t i = 0; i < p.files.size(); i++) {
+        GLuint shaderID = glCreateShader(types[i]);
+        submitShader(shaderID, p.files[i].c_str(), readShaderSource(p.files[i].c_str()));
+        p.shaders.push_back(shaderID);
     }
 
-    // Link the program
+    // Link the program, no status query so the compiles don't block here
     cout << "Linking shaders... " << endl;
-    GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    if (geometryFilePath)
-        glAttachShader(programID, geometryShaderID);
-    glAttachShader(programID, fragmentShaderID);
-    glLinkProgram(programID);
-
-    // Check the program
-    GLint result = GL_FALSE;
-    int infoLogLength;
-    glGetProgramiv(programID, GL_LINK_STATUS, &result);
-    glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
-    if (infoLogLength > 0) {
-        std::vector<char> programErrorMessage(infoLogLength + 1);
-        glGetProgramInfoLog(programID, infoLogLength, NULL, &programErrorMessage[0]);
-        //throw runtime_error(string(&programErrorMessage[0]));
-        cout << &programErrorMessage[0] << endl;
-    }
+    p.program = glCreateProgram();
+    for (GLuint shaderID : p.shaders) glAttachShader(p.program, shaderID);
+    glLinkProgram(p.program);
 
-    glDetachShader(programID, vertexShaderID);
-    glDeleteShader(vertexShaderID);
+    pending.push_back(p);
+    return p.program;
+}
 
-    if (geometryFilePath) {
-        glDetachShader(programID, geometryShaderID);
-        glDeleteShader(geometryShaderID);
+bool ShaderBatch::isReady(GLuint program) const {
+    if (!parallelCompileSupported()) return true;
+    for (const Pending& p : pending) {
+        if (p.program != program) continue;
+        GLint done = GL_TRUE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &done);
+        return done == GL_TRUE;
     }
+    return true;
+}
+
+GLuint ShaderBatch::finish(GLuint program) {
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].program != program) continue;
+        Pending p = pending[i];
+        pending.erase(pending.begin() + i);
+
+        for (size_t j = 0; j < p.shaders.size(); j++) checkShader(p.shaders[j], p.files[j]);
+
+        // Check the program
+        GLint result = GL_FALSE;
+        int infoLogLength;
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength > 0) {
+            std::vector<char> programErrorMessage(infoLogLength + 1);
+            glGetProgramInfoLog(program, infoLogLength, NULL, &programErrorMessage[0]);
+            //throw runtime_error(string(&programErrorMessage[0]));
+            cout << &programErrorMessage[0] << endl;
+        }
 
-    glDetachShader(programID, fragmentShaderID);
-    glDeleteShader(fragmentShaderID);
+        for (GLuint shaderID : p.shaders) {
+            glDetachShader(program, shaderID);
+            glDeleteShader(shaderID);
+        }
 
-    cout << "Shader program complete." << endl;
+        cout << "Shader program complete: " << p.files[1] << endl;
+        break;
+    }
+    return program;
+}
+
+void ShaderBatch::finish() {
+    while (!pending.empty()) finish(pending.front().program);
+}
 
-    return programID;
-}
\ No newline at end of file
+GLuint loadShaders(const char* vertexFilePath,
+                   const char* fragmentFilePath,
+                   const char* geometryFilePath) {
+    ShaderBatch batch;
+    return batch.finish(batch.add(vertexFilePath, fragmentFilePath, geometryFilePath));
+}
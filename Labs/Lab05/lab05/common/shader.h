@@ -1,8 +1,45 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <vector>
+#include <string>
+
 GLuint loadShaders(const char* vertexFilePath,
                    const char* fragmentFilePath,
                    const char* geometryFilePath = nullptr);
 
+/**
+* Builds several programs at once. add() submits the compiles and the link
+* without querying their status, so the driver can work on all of them in
+* parallel (on its own threads with KHR/ARB_parallel_shader_compile) while the
+* caller goes on. finish() waits for a program and prints its logs; call it
+* before the first use. Programs still pending are finished by the destructor.
+*/
+class ShaderBatch {
+public:
+    ShaderBatch();
+    ~ShaderBatch();
+    ShaderBatch(const ShaderBatch&) = delete;
+
+    /* Same arguments as loadShaders(), returns the program */
+    GLuint add(const char* vertexFilePath,
+               const char* fragmentFilePath,
+               const char* geometryFilePath = nullptr);
+
+    /* Whether finish() would not wait, always true without the extension */
+    bool isReady(GLuint program) const;
+
+    /* Waits for one or all programs and checks them, returns `program` */
+    GLuint finish(GLuint program);
+    void finish();
+
+private:
+    struct Pending {
+        GLuint program;
+        std::vector<GLuint> shaders;
+        std::vector<std::string> files; // vertex, fragment[, geometry]
+    };
+    std::vector<Pending> pending;
+};
+
 #endif
\ No newline at end of file
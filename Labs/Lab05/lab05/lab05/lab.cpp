@@ -17,6 +17,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/gl_state.h>
 #include <common/camera.h>
 #include <common/model.h>
 #include <common/texture.h>
@@ -106,10 +107,10 @@ struct ShaderInfo
 
 vector<ShaderInfo> shaderList;
 
-ShaderInfo setupShader(const char* vertexPath, const char* fragmentPath)
+ShaderInfo setupShader(GLuint programID)
 {
     ShaderInfo s;
-    s.programID = loadShaders(vertexPath, fragmentPath);
+    s.programID = programID;
 
     // Get locations specific to THIS program
     s.P_Location = glGetUniformLocation(s.programID, "P");
@@ -129,7 +130,10 @@ ShaderInfo setupShader(const char* vertexPath, const char* fragmentPath)
 void createContext()
 {
     // Create and compile our GLSL program from the shaders
-    shaderProgram = loadShaders("PhongShading.vertexshader", "PhongShading.fragmentshader");
+    // All the programs are submitted first and checked on first use, so the
+    // driver compiles them together (and while the textures load)
+    ShaderBatch shaders;
+    shaderProgram = shaders.add("PhongShading.vertexshader", "PhongShading.fragmentshader");
 
     // Homework 2: implement Gouraud shading.
     //shaderProgram = loadShaders("GouraudShading.vertexshader", "GouraudShading.fragmentshader");
@@ -137,10 +141,17 @@ void createContext()
     // Homework 3: implement flat shading.
     //shaderProgram = loadShaders("FlatShading.vertexshader", "FlatShading.fragmentshader");
     
+    // ===< Homework 6A >=== //
+    GLuint flatProgram    = shaders.add("FlatShading.vertexshader",    "FlatShading.fragmentshader");
+    GLuint gouraudProgram = shaders.add("GouraudShading.vertexshader", "GouraudShading.fragmentshader");
+    GLuint phongProgram   = shaders.add("PhongShading.vertexshader",   "PhongShading.fragmentshader");
+    
     // Task 6.2: load diffuse and specular texture maps
     diffuseTexture  = loadSOIL("suzanne_diffuse.bmp");
 	specularTexture = loadSOIL("suzanne_specular.bmp"); // Έτσι γυαλίζουν μόνο τα μάτια!
 
+    shaders.finish(shaderProgram);
+
     // Task 6.3: get a pointer to the texture samplers (diffuseColorSampler, specularColorSampler)
 	diffuseColorSampler  = glGetUniformLocation(shaderProgram, "diffuseColorSampler");
 	specularColorSampler = glGetUniformLocation(shaderProgram, "specularColorSampler");
@@ -168,9 +179,9 @@ void createContext()
 
 
 	// ===< Homework 6A >=== //
-    shaderList.push_back(setupShader("FlatShading.vertexshader",    "FlatShading.fragmentshader"));
-    shaderList.push_back(setupShader("GouraudShading.vertexshader", "GouraudShading.fragmentshader"));
-    shaderList.push_back(setupShader("PhongShading.vertexshader",   "PhongShading.fragmentshader"));
+    shaderList.push_back(setupShader(shaders.finish(flatProgram)));
+    shaderList.push_back(setupShader(shaders.finish(gouraudProgram)));
+    shaderList.push_back(setupShader(shaders.finish(phongProgram)));
 
 
 
@@ -209,9 +220,12 @@ void createContext()
 
 void free()
 {
-    glDeleteTextures(1, &diffuseTexture);
-    glDeleteTextures(1, &specularTexture);
-    glDeleteProgram(shaderProgram);
+    GLState::deleteTextures(1, &diffuseTexture);
+    GLState::deleteTextures(1, &specularTexture);
+    GLState::deleteProgram(shaderProgram);
+
+    GLState::printReport();
+
     glfwTerminate();
 }
 
@@ -223,7 +237,7 @@ void mainLoop()
     {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(shaderProgram);
+        GLState::useProgram(shaderProgram);
 
         // camera
         camera->update();
@@ -253,12 +267,10 @@ void mainLoop()
         glUniform1f(light_powerLocation,    lightPower);
 
         // Task 6.4: bind textures and transmit the diffuse and specular maps to the GPU
-        glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseTexture);
+		GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, diffuseTexture);
 		glUniform1i(diffuseColorSampler, 0);
 
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularTexture);
+		GLState::bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, specularTexture);
 		glUniform1i(specularColorSampler, 1);
 
         // Task 1.5: draw
@@ -289,7 +301,7 @@ void mainLoop()
             ShaderInfo& currentShader = shaderList[shaderIndex];
 
 			// Ενεργοποίηση του κατάλληλου shader
-            glUseProgram(currentShader.programID);
+            GLState::useProgram(currentShader.programID);
 
             float temp     = 3.0f;
             float x_offset = i * temp - temp;
@@ -306,12 +318,10 @@ void mainLoop()
             glUniform3fv(currentShader.lightPosLocation, 1, &lightPos[0]);
 
             // Textures
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, diffuseTexture);
+            GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, diffuseTexture);
             glUniform1i(currentShader.diffuseSamplerLocation, 0);
 
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, specularTexture);
+            GLState::bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, specularTexture);
             glUniform1i(currentShader.specularSamplerLocation, 1);
 
             obj->draw();
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <iostream>
 #include "texture.h"
+#include "gl_state.h"
 using namespace std;
 
 GLuint loadBMP(const char* imagePath) {
@@ -75,7 +76,7 @@ GLuint loadBMP(const char* imagePath) {
     glGenTextures(1, &textureID);
 
     // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
 
     // Give the image to OpenGL
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
@@ -187,7 +188,7 @@ GLuint loadDDS(const char* imagePath) {
     glGenTextures(1, &textureID);
 
     // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
@@ -226,6 +227,7 @@ GLuint loadSOIL(const char* imagePath) {
         SOIL_CREATE_NEW_ID,
         SOIL_FLAG_TEXTURE_REPEATS | SOIL_FLAG_POWER_OF_TWO
     );
+    GLState::invalidate(); // SOIL binds the texture it creates
 
     // error check
     if (texture == 0) {
@@ -15,6 +15,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/gl_state.h>
 #include <common/camera.h>
 #include <common/model.h>
 #include <common/texture.h>
@@ -311,13 +312,13 @@ void createContext()
 	glGenFramebuffers(1, &depthFBO);
 	// Binding the framebuffer, all changes bellow will affect the binded framebuffer
 	// **Don't forget to bind the default framebuffer at the end of initialization
-	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, depthFBO);
 
 
 
 	// We need a texture to store the depth image
 	glGenTextures(1, &depthTexture);
-	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, depthTexture);
 	// Telling opengl the required information about the texture
 	glTexImage2D(
 		GL_TEXTURE_2D,
@@ -358,10 +359,10 @@ void createContext()
 
 	// ===< HOMEWORK 2 >=== //
 	glGenFramebuffers(1, &depthFBO2);
-	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO2);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, depthFBO2);
 
 	glGenTextures(1, &depthTexture2);
-	glBindTexture(GL_TEXTURE_2D, depthTexture2);
+	GLState::bindTexture(GL_TEXTURE_2D, depthTexture2);
 	glTexImage2D(
 		GL_TEXTURE_2D,
 		0,
@@ -396,7 +397,7 @@ void createContext()
 	}
 
 	// Binding the default framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
@@ -404,9 +405,11 @@ void createContext()
 void free()
 {
 	// Delete Shader Programs
-	glDeleteProgram(shaderProgram);
-	glDeleteProgram(depthProgram);
-	glDeleteProgram(miniMapProgram);
+	GLState::deleteProgram(shaderProgram);
+	GLState::deleteProgram(depthProgram);
+	GLState::deleteProgram(miniMapProgram);
+
+	GLState::printReport();
 
 	glfwTerminate();
 }
@@ -421,13 +424,13 @@ void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo)
 	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
 	// Binding the depth framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, fbo);
 
 	// Cleaning the framebuffer depth information (stored from the last render)
 	glClear(GL_DEPTH_BUFFER_BIT);
 
 	// Selecting the new shader program that will output the depth component
-	glUseProgram(depthProgram);
+	GLState::useProgram(depthProgram);
 
 	// sending the view and projection matrix to the shader
 	mat4 view_projection = projectionMatrix * viewMatrix;
@@ -458,7 +461,7 @@ void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo)
 
 
 	// binding the default framebuffer again
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
@@ -466,14 +469,14 @@ void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo)
 void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix)
 {
 	// Step 1: Binding a frame buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 	glViewport(0, 0, W_WIDTH, W_HEIGHT);
 
 	// Step 2: Clearing color and depth info
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// Step 3: Selecting shader program
-	glUseProgram(shaderProgram);
+	GLState::useProgram(shaderProgram);
 
 	// Making view and projection matrices uniform to the shader program
 	glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
@@ -487,8 +490,7 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix)
 
 	// Task 4.1 Display shadows on the plane
 	// Sending the shadow texture to the shaderProgram
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	GLState::bindTexture(GL_TEXTURE2, GL_TEXTURE_2D, depthTexture);
 	glUniform1i(depthMapSampler1, 2);
 
 	// Sending the light View-Projection matrix to the shader program
@@ -500,8 +502,7 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix)
 	// ===< HOMEWORK 2 >=== //
 	uploadLight(*light2, LaLocation2, LdLocation2, LsLocation2, light2PositionLocation);
 
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, depthTexture2);
+	GLState::bindTexture(GL_TEXTURE3, GL_TEXTURE_2D, depthTexture2);
 	glUniform1i(depthMapSampler2, 3);
 
 	mat4 light2VP = light2->lightVP();
@@ -518,12 +519,10 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix)
 	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &modelMatrix[0][0]);
 
 	// Setting up texture to display on shader program          //  --- Texture Pipeline ---
-	glActiveTexture(GL_TEXTURE0);								// Activate texture position
-	glBindTexture(GL_TEXTURE_2D, modelDiffuseTexture);			// Assign texture to position 
+	GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, modelDiffuseTexture); // Assign texture to position 0
 	glUniform1i(diffuseColorSampler, 0);						// Assign sampler to that position
 
-	glActiveTexture(GL_TEXTURE1);								//
-	glBindTexture(GL_TEXTURE_2D, modelSpecularTexture);			// Same process for specular texture
+	GLState::bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, modelSpecularTexture); // Same process for specular texture
 	glUniform1i(specularColorSampler, 1);						//
 
 	// Inside the fragment shader, there is an if statement whether to use  
@@ -604,11 +603,10 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix)
 void renderMiniMap()
 {
 	// using the correct shaders to visualize the depth texture on the quad
-	glUseProgram(miniMapProgram);
+	GLState::useProgram(miniMapProgram);
 
 	//enabling the texture - follow the aforementioned pipeline
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, lightController == 1 ? depthTexture : depthTexture2); // HOMEWORK 1
+	GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, lightController == 1 ? depthTexture : depthTexture2); // HOMEWORK 1
 	glUniform1i(quadTextureSamplerLocation, 0);
 
 	// Drawing the quad
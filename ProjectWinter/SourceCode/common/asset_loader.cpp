@@ -0,0 +1,197 @@
+#include <iostream>
+#include <chrono>
+#include <future>
+#include "model.h"
+#include "texture.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+#include "asset_loader.h"
+
+using namespace std;
+
+static double now() {
+    using namespace std::chrono;
+    return duration<double, milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct AssetLoader::Asset {
+    string path;
+    GLuint* texture;
+    Drawable** drawable;
+    bool bmp;
+    bool dds;
+    // the sources of a packed mask texture or of a texture array
+    vector<string> sources;
+    bool array;
+    VertexLayout layout;
+    Image image;
+    vector<Image> layers;
+    CompressedImage compressed;
+    vector<CompressedImage> compressedLayers;
+    // the texture cache entry of a bmp, soil, masks or array texture
+    uint64_t cacheKey;
+    TextureCache cache;
+    bool cached;
+    MeshData mesh;
+    double decodeTime;
+    future<void> decoded;
+};
+
+static bool isDDS(const string& path) {
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".dds") == 0;
+}
+
+AssetLoader::AssetLoader() : startTime(now()) {}
+
+AssetLoader::~AssetLoader() {
+    // the tasks write into the assets
+    for (auto& asset : assets) {
+        if (asset->decoded.valid()) asset->decoded.wait();
+    }
+}
+
+void AssetLoader::bmp(const string& path, GLuint* texture) {
+    queue(path, texture, nullptr, true);
+}
+
+void AssetLoader::soil(const string& path, GLuint* texture) {
+    queue(path, texture, nullptr, false);
+}
+
+void AssetLoader::dds(const string& path, GLuint* texture) {
+    Asset* asset = new Asset();
+    asset->path = path;
+    asset->texture = texture;
+    asset->drawable = nullptr;
+    asset->dds = true;
+    submit(asset);
+}
+
+void AssetLoader::masks(const vector<string>& paths, GLuint* texture) {
+    queueSources(paths, texture, false);
+}
+
+void AssetLoader::textureArray(const vector<string>& paths, GLuint* texture) {
+    queueSources(paths, texture, true);
+}
+
+void AssetLoader::queueSources(const vector<string>& paths, GLuint* texture, bool array) {
+    Asset* asset = new Asset();
+    for (const string& path : paths) {
+        asset->path += (asset->path.empty() ? "" : ", ") + path;
+    }
+    asset->texture = texture;
+    asset->drawable = nullptr;
+    asset->bmp = true;
+    asset->sources = paths;
+    asset->array = array;
+    // cooked layers are all .dds, see tools/texture_cooker
+    asset->dds = array && !paths.empty() && isDDS(paths[0]);
+    submit(asset);
+}
+
+void AssetLoader::drawable(const string& path, Drawable** drawable, VertexLayout layout) {
+    queue(path, nullptr, drawable, false, layout);
+}
+
+void AssetLoader::queue(const string& path, GLuint* texture, Drawable** drawable, bool bmp,
+                        VertexLayout layout) {
+    Asset* asset = new Asset();
+    asset->path = path;
+    asset->texture = texture;
+    asset->drawable = drawable;
+    asset->bmp = bmp;
+    asset->dds = false;
+    asset->layout = layout;
+    submit(asset);
+}
+
+void AssetLoader::submit(Asset* asset) {
+    assets.emplace_back(asset);
+    asset->decoded = ThreadPool::shared().submit([asset] {
+        double start = now();
+        // .dds files are GPU ready already, everything else may be cached
+        if (!asset->drawable && !asset->dds && textureCaching()) {
+            const char* flags = asset->array ? TEXTURE_CACHE_ARRAY :
+                !asset->sources.empty() ? TEXTURE_CACHE_MASKS :
+                asset->bmp ? TEXTURE_CACHE_BMP : TEXTURE_CACHE_SOIL;
+            asset->cacheKey = TextureCache::key(
+                asset->sources.empty() ? vector<string>{asset->path} : asset->sources, flags);
+            asset->cached = asset->cacheKey && asset->cache.open(asset->cacheKey);
+        }
+
+        if (asset->cached) {
+            // nothing to decode
+        } else if (asset->drawable) {
+            asset->mesh = loadMeshData(asset->path);
+        } else if (asset->array && asset->dds) {
+            for (const string& path : asset->sources) {
+                asset->compressedLayers.push_back(decodeDDS(path.c_str()));
+            }
+        } else if (asset->array) {
+            for (const string& path : asset->sources) {
+                asset->layers.push_back(decodeBMP(path.c_str()));
+            }
+        } else if (!asset->sources.empty()) {
+            vector<Image> masks;
+            vector<const Image*> channels;
+            for (const string& path : asset->sources) {
+                masks.push_back(decodeMaskBMP(path.c_str()));
+            }
+            for (const Image& mask : masks) channels.push_back(&mask);
+            asset->image = packMasks(channels);
+        } else if (asset->dds) {
+            asset->compressed = decodeDDS(asset->path.c_str());
+        } else if (asset->bmp) {
+            asset->image = decodeBMP(asset->path.c_str());
+        } else {
+            asset->image = decodeSOIL(asset->path.c_str());
+        }
+        asset->decodeTime = now() - start;
+    });
+}
+
+void AssetLoader::finish() {
+    size_t count = assets.size();
+    for (auto& asset : assets) {
+        asset->decoded.get();
+
+        double start = now();
+        if (asset->drawable) {
+            *asset->drawable = new Drawable(std::move(asset->mesh), getDefaultRetention(),
+                                            asset->layout);
+        } else if (asset->cached) {
+            *asset->texture = asset->cache.upload();
+            asset->cache.close();
+        } else {
+            if (asset->array && asset->dds) {
+                vector<const CompressedImage*> layers;
+                for (const CompressedImage& layer : asset->compressedLayers) layers.push_back(&layer);
+                *asset->texture = uploadTextureArray(layers);
+            } else if (asset->array) {
+                vector<const Image*> layers;
+                for (const Image& layer : asset->layers) layers.push_back(&layer);
+                *asset->texture = uploadTextureArray(layers);
+            } else if (!asset->sources.empty()) {
+                *asset->texture = uploadMasks(asset->image);
+            } else if (asset->dds) {
+                *asset->texture = uploadDDS(asset->compressed);
+            } else {
+                *asset->texture = asset->bmp ? uploadBMP(asset->image) : uploadSOIL(asset->image);
+            }
+            asset->image = Image();
+            asset->layers.clear();
+            asset->compressed = CompressedImage();
+            asset->compressedLayers.clear();
+            TextureCache::save(asset->cacheKey, asset->array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D,
+                               *asset->texture);
+        }
+        cout << "Loaded " << asset->path << (asset->cached ? " from the texture cache" : "") << ": decode " << asset->decodeTime
+            << " ms, upload " << now() - start << " ms" << endl;
+    }
+    assets.clear();
+
+    cout << "Loaded " << count << " assets in " << now() - startTime << " ms ("
+        << ThreadPool::shared().size() << " threads)" << endl;
+    startTime = now();
+}
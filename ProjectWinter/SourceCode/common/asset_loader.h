@@ -0,0 +1,52 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include "model.h"
+
+/**
+* Loads a batch of textures and meshes. Files are decoded/parsed on the
+* shared ThreadPool as soon as they are queued; finish() uploads them on the
+* calling (GL) thread in queue order and prints per asset timings. The
+* targets are only written by finish().
+*/
+class AssetLoader {
+public:
+    AssetLoader();
+    /* Waits for queued work that wasn't finish()ed, without uploading it */
+    ~AssetLoader();
+
+    /* Same as *texture = loadBMP(path) / loadSOIL(path) */
+    void bmp(const std::string& path, GLuint* texture);
+    void soil(const std::string& path, GLuint* texture);
+    /* Same as *texture = loadDDS(path) */
+    void dds(const std::string& path, GLuint* texture);
+    /* The red channels of up to four .bmp files packed in one texture, see packMasks() */
+    void masks(const std::vector<std::string>& paths, GLuint* texture);
+    /* The .bmp (or all .dds) files as the layers of one GL_TEXTURE_2D_ARRAY, see uploadTextureArray() */
+    void textureArray(const std::vector<std::string>& paths, GLuint* texture);
+    /* Same as *drawable = new Drawable(path, default retention, layout) */
+    void drawable(const std::string& path, Drawable** drawable,
+                  VertexLayout layout = getDefaultVertexLayout());
+
+    /* Rethrows the first decode error */
+    void finish();
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+private:
+    struct Asset;
+    std::vector<std::unique_ptr<Asset>> assets;
+    double startTime;
+
+    void queue(const std::string& path, GLuint* texture, Drawable** drawable, bool bmp,
+               VertexLayout layout = VertexLayout::Separate);
+    void queueSources(const std::vector<std::string>& paths, GLuint* texture, bool array);
+    void submit(Asset* asset);
+};
+
+#endif
@@ -0,0 +1,421 @@
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "parallel.h"
+#include "block_compress.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_COMPRESS_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+size_t blockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t compressedSize(BlockFormat format, int width, int height) {
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// The 4x4 block at (bx, by) as 16 RGBA texels, edges clamped
+static void loadBlock(const unsigned char* rgba, int width, int height, int bx, int by,
+                      unsigned char block[64]) {
+    for (int y = 0; y < 4; y++) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t) sy * width + sx) * 4], 4);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// BC1 colour blocks
+
+static uint16_t pack565(const float c[3]) {
+    int r = (int) (std::min(std::max(c[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int) (std::min(std::max(c[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int) (std::min(std::max(c[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static void unpack565(uint16_t v, int c[3]) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+// The four colours of a block in 4 colour mode: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+static void colorPalette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int i = 0; i < 3; i++) {
+        palette[2][i] = (2 * palette[0][i] + palette[1][i] + 1) / 3;
+        palette[3][i] = (palette[0][i] + 2 * palette[1][i] + 1) / 3;
+    }
+}
+
+// Picks the nearest palette colour of every texel, returns the squared error
+static int fitColorIndices(const unsigned char block[64], const int palette[4][3],
+                           unsigned char indices[16]) {
+#ifdef BLOCK_COMPRESS_SSE2
+    const __m128i rgbMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i colors[4];
+    for (int k = 0; k < 4; k++) {
+        colors[k] = _mm_set_epi16(0, (short) palette[k][2], (short) palette[k][1], (short) palette[k][0],
+                                  0, (short) palette[k][2], (short) palette[k][1], (short) palette[k][0]);
+    }
+
+    __m128i total = zero;
+    for (int group = 0; group < 4; group++) {
+        __m128i texels = _mm_loadu_si128((const __m128i*) &block[group * 16]);
+        __m128i low = _mm_and_si128(_mm_unpacklo_epi8(texels, zero), rgbMask);
+        __m128i high = _mm_and_si128(_mm_unpackhi_epi8(texels, zero), rgbMask);
+
+        __m128i best = zero, index = zero;
+        for (int k = 0; k < 4; k++) {
+            __m128i dl = _mm_sub_epi16(low, colors[k]);
+            __m128i dh = _mm_sub_epi16(high, colors[k]);
+            // r*r + g*g and b*b of two texels each, then summed per texel
+            __m128 sl = _mm_castsi128_ps(_mm_madd_epi16(dl, dl));
+            __m128 sh = _mm_castsi128_ps(_mm_madd_epi16(dh, dh));
+            __m128i distance = _mm_add_epi32(
+                _mm_castps_si128(_mm_shuffle_ps(sl, sh, _MM_SHUFFLE(2, 0, 2, 0))),
+                _mm_castps_si128(_mm_shuffle_ps(sl, sh, _MM_SHUFFLE(3, 1, 3, 1))));
+            if (k == 0) {
+                best = distance;
+                continue;
+            }
+            __m128i closer = _mm_cmplt_epi32(distance, best);
+            best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+            index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+                                 _mm_andnot_si128(closer, index));
+        }
+        total = _mm_add_epi32(total, best);
+
+        int32_t lanes[4];
+        _mm_storeu_si128((__m128i*) lanes, index);
+        for (int i = 0; i < 4; i++) indices[group * 4 + i] = (unsigned char) lanes[i];
+    }
+
+    int32_t sums[4];
+    _mm_storeu_si128((__m128i*) sums, total);
+    return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+    int error = 0;
+    for (int i = 0; i < 16; i++) {
+        const unsigned char* texel = &block[i * 4];
+        int best = 0, bestDistance = 1 << 30;
+        for (int k = 0; k < 4; k++) {
+            int dr = texel[0] - palette[k][0];
+            int dg = texel[1] - palette[k][1];
+            int db = texel[2] - palette[k][2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        indices[i] = (unsigned char) best;
+        error += bestDistance;
+    }
+    return error;
+#endif
+}
+
+struct ColorFit {
+    uint16_t c0, c1;
+    unsigned char indices[16];
+    int error;
+};
+
+// Quantizes a pair of endpoints and keeps it in `best` if it fits better
+static void tryEndpoints(const unsigned char block[64], const float e0[3], const float e1[3],
+                         ColorFit& best) {
+    ColorFit fit;
+    fit.c0 = pack565(e0);
+    fit.c1 = pack565(e1);
+    int palette[4][3];
+    colorPalette(fit.c0, fit.c1, palette);
+    fit.error = fitColorIndices(block, palette, fit.indices);
+    if (fit.error < best.error) best = fit;
+}
+
+// Least squares endpoints for the indices of `fit`, false if they are degenerate
+static bool refitEndpoints(const unsigned char block[64], const ColorFit& fit,
+                           float e0[3], float e1[3]) {
+    static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float a = 0, b = 0, c = 0, x[3] = {0, 0, 0}, y[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        float w = weights[fit.indices[i]];
+        a += w * w;
+        b += w * (1 - w);
+        c += (1 - w) * (1 - w);
+        for (int j = 0; j < 3; j++) {
+            x[j] += w * block[i * 4 + j];
+            y[j] += (1 - w) * block[i * 4 + j];
+        }
+    }
+    float det = a * c - b * b;
+    if (std::fabs(det) < 1e-6f) return false;
+    for (int j = 0; j < 3; j++) {
+        e0[j] = (c * x[j] - b * y[j]) / det;
+        e1[j] = (a * y[j] - b * x[j]) / det;
+    }
+    return true;
+}
+
+static void encodeColorBlock(const unsigned char block[64], unsigned char* out) {
+    // Mean and covariance of the texels
+    float mean[3] = {0, 0, 0}, low[3] = {255, 255, 255}, high[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 3; j++) {
+            float v = block[i * 4 + j];
+            mean[j] += v / 16.0f;
+            low[j] = std::min(low[j], v);
+            high[j] = std::max(high[j], v);
+        }
+    }
+    float cov[6] = {0, 0, 0, 0, 0, 0}; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++) {
+        float d[3] = {block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2]};
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    // Principal axis by power iteration, starting from the bounding box diagonal
+    float axis[3] = {high[0] - low[0], high[1] - low[1], high[2] - low[2]};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+        };
+        float length = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::fabs(next[2]));
+        if (length < 1e-6f) break;
+        for (int j = 0; j < 3; j++) axis[j] = next[j] / length;
+    }
+
+    ColorFit best;
+    best.error = 1 << 30;
+
+    // Candidate 1: the extreme texels along the principal axis
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0;
+        for (int j = 0; j < 3; j++) t += (block[i * 4 + j] - mean[j]) * axis[j];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    if (norm > 1e-12f) {
+        float e0[3], e1[3];
+        for (int j = 0; j < 3; j++) {
+            e0[j] = mean[j] + axis[j] * maxT / norm;
+            e1[j] = mean[j] + axis[j] * minT / norm;
+        }
+        tryEndpoints(block, e0, e1, best);
+    }
+
+    // Candidate 2: the bounding box, oriented like the axis
+    float e0[3], e1[3];
+    for (int j = 0; j < 3; j++) {
+        e0[j] = axis[j] >= 0 ? high[j] : low[j];
+        e1[j] = axis[j] >= 0 ? low[j] : high[j];
+    }
+    tryEndpoints(block, e0, e1, best);
+
+    // Refine the best with least squares fits to its own indices
+    for (int iteration = 0; iteration < 2; iteration++) {
+        int before = best.error;
+        if (before == 0 || !refitEndpoints(block, best, e0, e1)) break;
+        tryEndpoints(block, e0, e1, best);
+        if (best.error >= before) break;
+    }
+
+    // 4 colour mode needs c0 > c1, swapping them swaps indices 0/1 and 2/3
+    if (best.c0 < best.c1) {
+        std::swap(best.c0, best.c1);
+        for (int i = 0; i < 16; i++) best.indices[i] ^= 1;
+    } else if (best.c0 == best.c1) {
+        memset(best.indices, 0, sizeof(best.indices));
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++) bits |= (uint32_t) best.indices[i] << (2 * i);
+    out[0] = best.c0 & 0xFF; out[1] = best.c0 >> 8;
+    out[2] = best.c1 & 0xFF; out[3] = best.c1 >> 8;
+    for (int i = 0; i < 4; i++) out[4 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+// ---------------------------------------------------------------------------
+// BC4 single channel blocks, also the alpha of BC3 and both halves of BC5
+
+// 8 values (a0 > a1) or 6 values plus 0 and 255 (a0 <= a1)
+static void channelPalette(int a0, int a1, int palette[8]) {
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int k = 1; k < 7; k++) palette[k + 1] = ((7 - k) * a0 + k * a1 + 3) / 7;
+    } else {
+        for (int k = 1; k < 5; k++) palette[k + 1] = ((5 - k) * a0 + k * a1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+static int fitChannelIndices(const unsigned char values[16], const int palette[8],
+                             unsigned char indices[16]) {
+#ifdef BLOCK_COMPRESS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i texels = _mm_loadu_si128((const __m128i*) values);
+    __m128i halves[2] = {_mm_unpacklo_epi8(texels, zero), _mm_unpackhi_epi8(texels, zero)};
+
+    int error = 0;
+    for (int h = 0; h < 2; h++) {
+        __m128i best = _mm_set1_epi16(0x7FFF), index = zero;
+        for (int k = 0; k < 8; k++) {
+            __m128i value = _mm_set1_epi16((short) palette[k]);
+            __m128i distance = _mm_sub_epi16(_mm_max_epi16(halves[h], value),
+                                             _mm_min_epi16(halves[h], value));
+            __m128i closer = _mm_cmplt_epi16(distance, best);
+            best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+            index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi16((short) k)),
+                                 _mm_andnot_si128(closer, index));
+        }
+        int32_t squares[4];
+        _mm_storeu_si128((__m128i*) squares, _mm_madd_epi16(best, best));
+        error += squares[0] + squares[1] + squares[2] + squares[3];
+
+        int16_t lanes[8];
+        _mm_storeu_si128((__m128i*) lanes, index);
+        for (int i = 0; i < 8; i++) indices[h * 8 + i] = (unsigned char) lanes[i];
+    }
+    return error;
+#else
+    int error = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0, bestDistance = 1 << 30;
+        for (int k = 0; k < 8; k++) {
+            int distance = std::abs(values[i] - palette[k]);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        indices[i] = (unsigned char) best;
+        error += bestDistance * bestDistance;
+    }
+    return error;
+#endif
+}
+
+// `channel` of the block (0 r .. 3 a) as one BC4 block
+static void encodeChannelBlock(const unsigned char block[64], int channel, unsigned char* out) {
+    unsigned char values[16];
+    int low = 255, high = 0, innerLow = 255, innerHigh = 0;
+    for (int i = 0; i < 16; i++) {
+        int v = values[i] = block[i * 4 + channel];
+        low = std::min(low, v);
+        high = std::max(high, v);
+        if (v != 0 && v != 255) {
+            innerLow = std::min(innerLow, v);
+            innerHigh = std::max(innerHigh, v);
+        }
+    }
+
+    int bestA0 = high, bestA1 = low, bestError = 1 << 30;
+    unsigned char bestIndices[16] = {0};
+    int palette[8];
+    unsigned char indices[16];
+    if (high == low) {
+        bestError = 0;
+    } else {
+        // 8 value mode with the range pulled in by up to 2/28 from each end
+        int step = std::max(1, (high - low) / 28);
+        for (int i = 0; i < 3 && bestError > 0; i++) {
+            for (int j = 0; j < 3; j++) {
+                int a0 = high - i * step, a1 = low + j * step;
+                if (a0 <= a1) continue;
+                channelPalette(a0, a1, palette);
+                int error = fitChannelIndices(values, palette, indices);
+                if (error < bestError) {
+                    bestError = error;
+                    bestA0 = a0;
+                    bestA1 = a1;
+                    memcpy(bestIndices, indices, 16);
+                }
+            }
+        }
+        // 6 value mode keeps exact 0 and 255 for the texels that have them
+        if (bestError > 0 && (low == 0 || high == 255) && innerLow <= innerHigh) {
+            channelPalette(innerLow, innerHigh, palette);
+            int error = fitChannelIndices(values, palette, indices);
+            if (error < bestError) {
+                bestError = error;
+                bestA0 = innerLow;
+                bestA1 = innerHigh;
+                memcpy(bestIndices, indices, 16);
+            }
+        }
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++) bits |= (uint64_t) bestIndices[i] << (3 * i);
+    out[0] = (unsigned char) bestA0;
+    out[1] = (unsigned char) bestA1;
+    for (int i = 0; i < 6; i++) out[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+// ---------------------------------------------------------------------------
+
+void compressImage(BlockFormat format, const unsigned char* rgba, int width, int height,
+                   unsigned char* out) {
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t bytes = blockBytes(format);
+    parallelFor((size_t) blocksY, [&](size_t by) {
+        unsigned char block[64];
+        for (int bx = 0; bx < blocksX; bx++) {
+            loadBlock(rgba, width, height, bx, (int) by, block);
+            unsigned char* dst = out + (by * blocksX + bx) * bytes;
+            switch (format) {
+            case BlockFormat::BC1:
+                encodeColorBlock(block, dst);
+                break;
+            case BlockFormat::BC3:
+                encodeChannelBlock(block, 3, dst);
+                encodeColorBlock(block, dst + 8);
+                break;
+            case BlockFormat::BC4:
+                encodeChannelBlock(block, 0, dst);
+                break;
+            case BlockFormat::BC5:
+                encodeChannelBlock(block, 0, dst);
+                encodeChannelBlock(block, 1, dst + 8);
+                break;
+            }
+        }
+    });
+}
+
+vector<unsigned char> downsample(const unsigned char* rgba, int width, int height) {
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    vector<unsigned char> out((size_t) w * h * 4);
+    for (int y = 0; y < h; y++) {
+        const unsigned char* row0 = rgba + (size_t) std::min(2 * y, height - 1) * width * 4;
+        const unsigned char* row1 = rgba + (size_t) std::min(2 * y + 1, height - 1) * width * 4;
+        for (int x = 0; x < w; x++) {
+            int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+            for (int c = 0; c < 4; c++) {
+                out[((size_t) y * w + x) * 4 + c] = (unsigned char)
+                    ((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
+        }
+    }
+    return out;
+}
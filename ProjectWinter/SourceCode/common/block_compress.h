@@ -0,0 +1,34 @@
+#ifndef BLOCK_COMPRESS_H
+#define BLOCK_COMPRESS_H
+
+#include <vector>
+#include <cstddef>
+
+/**
+* Block compression (S3TC/RGTC) of RGBA8 images, one 4x4 block at a time:
+* BC1 (DXT1) stores rgb in 4 bits per texel, BC3 (DXT5) rgb + a in 8,
+* BC4 (RGTC1) r in 4 and BC5 (RGTC2) r + g in 8. Colour endpoints are
+* searched along the principal axis and the bounding box of the block, then
+* refit to the chosen indices, keeping whichever candidate has the lowest
+* error; the index search uses SSE2 where available, scalar code otherwise.
+*/
+enum class BlockFormat { BC1, BC3, BC4, BC5 };
+
+/* Bytes of one 4x4 block */
+size_t blockBytes(BlockFormat format);
+
+/* Bytes of a width x height image, partial blocks at the edges included */
+size_t compressedSize(BlockFormat format, int width, int height);
+
+/**
+* Compresses a width x height RGBA8 image into compressedSize() bytes at
+* `out`, blocks in rows from the top left. Edge blocks repeat the last row
+* and column. Block rows are spread over workerCount() threads.
+*/
+void compressImage(BlockFormat format, const unsigned char* rgba, int width, int height,
+                   unsigned char* out);
+
+/* The next mip level of an RGBA8 image, max(1, size / 2), 2x2 box filter */
+std::vector<unsigned char> downsample(const unsigned char* rgba, int width, int height);
+
+#endif
@@ -0,0 +1,281 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include "geometry_pool.h"
+#include "gl_state.h"
+
+using namespace std;
+using namespace glm;
+
+static size_t positionSize(VertexLayout layout) {
+    return layout == VertexLayout::Quantized ? 8 : sizeof(vec3);
+}
+
+static size_t normalSize(VertexLayout layout, bool normals) {
+    if (!normals) return 0;
+    return layout == VertexLayout::Interleaved ? sizeof(vec3) : 4;
+}
+
+size_t vertexStride(VertexLayout layout, bool normals, bool uvs) {
+    size_t uvSize = uvs ? (layout == VertexLayout::Interleaved ? sizeof(vec2) : 4) : 0;
+    return positionSize(layout) + normalSize(layout, normals) + uvSize;
+}
+
+vector<unsigned char> encodeVertices(
+    VertexLayout layout, const vec3* vertices, const vec3* normals, const vec2* uvs,
+    size_t vertexCount, mat4& dequantization) {
+    bool packed = layout != VertexLayout::Interleaved;
+    size_t stride = vertexStride(layout, normals != nullptr, uvs != nullptr);
+    dequantization = mat4();
+
+    // positions are stored relative to the bounds
+    vec3 origin(0.0f), extent(1.0f);
+    if (layout == VertexLayout::Quantized && vertexCount) {
+        vec3 boundsMin = vertices[0], boundsMax = vertices[0];
+        for (size_t i = 0; i < vertexCount; i++) {
+            boundsMin = glm::min(boundsMin, vertices[i]);
+            boundsMax = glm::max(boundsMax, vertices[i]);
+        }
+        origin = boundsMin;
+        extent = glm::max(boundsMax - boundsMin, vec3(1e-6f));
+        dequantization = translate(mat4(), origin) * scale(mat4(), extent);
+    }
+
+    vector<unsigned char> data(vertexCount * stride);
+    for (size_t i = 0; i < vertexCount; i++) {
+        unsigned char* v = &data[i * stride];
+        if (layout == VertexLayout::Quantized) {
+            uint64 q = packUnorm4x16(vec4((vertices[i] - origin) / extent, 0.0f));
+            memcpy(v, &q, 8);
+        } else {
+            memcpy(v, &vertices[i], sizeof(vec3));
+        }
+        v += positionSize(layout);
+        if (normals) {
+            if (packed) {
+                uint32 n = packSnorm3x10_1x2(vec4(normals[i], 0.0f));
+                memcpy(v, &n, 4);
+            } else {
+                memcpy(v, &normals[i], sizeof(vec3));
+            }
+            v += normalSize(layout, true);
+        }
+        if (uvs) {
+            if (packed) {
+                uint32 t = packHalf2x16(uvs[i]);
+                memcpy(v, &t, 4);
+            } else {
+                memcpy(v, &uvs[i], sizeof(vec2));
+            }
+        }
+    }
+    return data;
+}
+
+void setVertexAttributes(VertexLayout layout, bool normals, bool uvs) {
+    bool packed = layout != VertexLayout::Interleaved;
+    size_t pSize = positionSize(layout), nSize = normalSize(layout, normals);
+    GLsizei s = static_cast<GLsizei>(vertexStride(layout, normals, uvs));
+    if (layout == VertexLayout::Quantized) {
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, s, (void*) 0);
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, s, (void*) 0);
+    }
+    glEnableVertexAttribArray(0);
+    if (normals) {
+        if (packed) {
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, s, (void*) pSize);
+        } else {
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, s, (void*) pSize);
+        }
+        glEnableVertexAttribArray(1);
+    }
+    if (uvs) {
+        glVertexAttribPointer(2, 2, packed ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, s,
+                              (void*) (pSize + nSize));
+        glEnableVertexAttribArray(2);
+    }
+}
+
+static bool geometryPooling = true;
+
+void setGeometryPooling(bool enabled) {
+    geometryPooling = enabled;
+}
+
+bool getGeometryPooling() {
+    return geometryPooling;
+}
+
+/*****************************************************************************/
+
+bool GeometryPool::FreeList::allocate(size_t size, size_t& offset) {
+    for (auto it = free.begin(); it != free.end(); ++it) {
+        if (it->second < size) continue;
+        offset = it->first;
+        size_t rest = it->second - size;
+        free.erase(it);
+        if (rest) free[offset + size] = rest;
+        return true;
+    }
+    return false;
+}
+
+void GeometryPool::FreeList::release(size_t offset, size_t size) {
+    if (!size) return;
+    auto next = free.lower_bound(offset);
+    if (next != free.end() && offset + size == next->first) {
+        size += next->second;
+        next = free.erase(next);
+    }
+    if (next != free.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    free[offset] = size;
+}
+
+void GeometryPool::FreeList::grow(size_t newCapacity) {
+    release(capacity, newCapacity - capacity);
+    capacity = newCapacity;
+}
+
+size_t GeometryPool::FreeList::used() const {
+    size_t unused = 0;
+    for (const auto& range : free) unused += range.second;
+    return capacity - unused;
+}
+
+/*****************************************************************************/
+
+// the pools by format, see formatKey()
+static map<int, GeometryPool*> pools;
+
+static int formatKey(VertexLayout layout, bool normals, bool uvs) {
+    return static_cast<int>(layout) * 4 + (normals ? 2 : 0) + (uvs ? 1 : 0);
+}
+
+static const char* layoutName(VertexLayout layout) {
+    switch (layout) {
+    case VertexLayout::Separate: return "Separate";
+    case VertexLayout::Interleaved: return "Interleaved";
+    case VertexLayout::Packed: return "Packed";
+    default: return "Quantized";
+    }
+}
+
+// initial sizes, the buffers double from there
+static const size_t MIN_POOL_VERTICES = 1 << 16;
+static const size_t MIN_POOL_INDEX_BYTES = 1 << 18;
+
+GeometryPool& GeometryPool::get(VertexLayout layout, bool normals, bool uvs) {
+    if (layout == VertexLayout::Separate) {
+        throw runtime_error("GeometryPool: the Separate layout can't be pooled");
+    }
+    GeometryPool*& pool = pools[formatKey(layout, normals, uvs)];
+    if (!pool) pool = new GeometryPool(layout, normals, uvs);
+    return *pool;
+}
+
+void GeometryPool::releaseAll() {
+    for (auto& pool : pools) delete pool.second;
+    pools.clear();
+}
+
+void GeometryPool::printReport() {
+    cout << "Geometry pools:" << endl;
+    for (const auto& entry : pools) {
+        const GeometryPool& p = *entry.second;
+        cout << "  " << layoutName(p.layout)
+            << (p.normals ? " +normals" : "") << (p.uvs ? " +uvs" : "")
+            << ": vertices " << p.vertexRanges.used() << "/" << p.vertexRanges.capacity
+            << ", index bytes " << p.indexRanges.used() << "/" << p.indexRanges.capacity
+            << ", free ranges " << p.vertexRanges.ranges() << "/" << p.indexRanges.ranges()
+            << endl;
+    }
+}
+
+GeometryPool::GeometryPool(VertexLayout layout, bool normals, bool uvs)
+    : layout(layout), normals(normals), uvs(uvs),
+    stride(vertexStride(layout, normals, uvs)), VAO(0), vertexBuffer(0), indexBuffer(0) {
+    glGenVertexArrays(1, &VAO);
+}
+
+GeometryPool::~GeometryPool() {
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    GLState::deleteVertexArrays(1, &VAO);
+}
+
+// new buffer of `newBytes`, holding the first `oldBytes` of `buffer`
+static GLuint growBuffer(GLuint buffer, size_t oldBytes, size_t newBytes) {
+    GLuint grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+    if (buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+        glDeleteBuffers(1, &buffer);
+    }
+    return grown;
+}
+
+void GeometryPool::growVertices(size_t minCapacity) {
+    size_t capacity = std::max(std::max(minCapacity, 2 * vertexRanges.capacity),
+                               MIN_POOL_VERTICES);
+    vertexBuffer = growBuffer(vertexBuffer, vertexRanges.capacity * stride, capacity * stride);
+    vertexRanges.grow(capacity);
+
+    GLState::bindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    setVertexAttributes(layout, normals, uvs);
+}
+
+void GeometryPool::growIndices(size_t minCapacity) {
+    size_t capacity = std::max(std::max(minCapacity, 2 * indexRanges.capacity),
+                               MIN_POOL_INDEX_BYTES);
+    indexBuffer = growBuffer(indexBuffer, indexRanges.capacity, capacity);
+    indexRanges.grow(capacity);
+
+    GLState::bindVertexArray(VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+}
+
+GeometryRange GeometryPool::allocate(const void* vertices, size_t vertexCount,
+                                     const void* indices, size_t indexBytes) {
+    GeometryRange range = {0, vertexCount, 0, indexBytes};
+    // 4 byte aligned, so 16 and 32 bit index ranges can share the buffer
+    size_t alignedBytes = (indexBytes + 3) & ~size_t(3);
+
+    if (vertexCount && !vertexRanges.allocate(vertexCount, range.baseVertex)) {
+        growVertices(vertexRanges.capacity + vertexCount);
+        vertexRanges.allocate(vertexCount, range.baseVertex);
+    }
+    if (alignedBytes && !indexRanges.allocate(alignedBytes, range.indexOffset)) {
+        growIndices(indexRanges.capacity + alignedBytes);
+        indexRanges.allocate(alignedBytes, range.indexOffset);
+    }
+
+    // copy targets leave the element binding of the bound VAO alone
+    if (vertexCount) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.baseVertex * stride, vertexCount * stride,
+                        vertices);
+    }
+    if (indexBytes) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.indexOffset, indexBytes, indices);
+    }
+    return range;
+}
+
+void GeometryPool::release(const GeometryRange& range) {
+    vertexRanges.release(range.baseVertex, range.vertexCount);
+    indexRanges.release(range.indexOffset, (range.indexBytes + 3) & ~size_t(3));
+}
@@ -0,0 +1,90 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <GL/glew.h>
+#include <map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "model.h"
+
+/* Bytes per vertex of an interleaved layout (anything but Separate) */
+size_t vertexStride(VertexLayout layout, bool normals, bool uvs);
+
+/**
+* Encodes vertices in an interleaved layout. `normals`/`uvs` may be nullptr.
+* For Quantized, `dequantization` is set to the matrix that maps the stored
+* positions back, otherwise to identity.
+*/
+std::vector<unsigned char> encodeVertices(
+    VertexLayout layout,
+    const glm::vec3* vertices, const glm::vec3* normals, const glm::vec2* uvs,
+    size_t vertexCount, glm::mat4& dequantization);
+
+/* Points attributes 0-2 of the bound VAO at the bound GL_ARRAY_BUFFER */
+void setVertexAttributes(VertexLayout layout, bool normals, bool uvs);
+
+/* Whether Drawables/Meshes with an interleaved layout use the pools, default on */
+void setGeometryPooling(bool enabled);
+bool getGeometryPooling();
+
+/**
+* Shared vertex and index buffers for every static mesh of one vertex format
+* (layout + which attributes are present), so all of them draw from a single
+* VAO with glDrawElementsBaseVertex. Ranges are handed out first fit from a
+* free list and merged with their free neighbours when released; a buffer
+* that is full grows to twice its size, copied on the GPU. GL thread only.
+*/
+class GeometryPool {
+public:
+    /* The pool of a format, created on first use */
+    static GeometryPool& get(VertexLayout layout, bool normals, bool uvs);
+
+    /* Deletes every pool, call before the GL context goes away */
+    static void releaseAll();
+
+    /* Prints the usage of every pool */
+    static void printReport();
+
+    /**
+    * Copies `vertexCount` vertices encoded with encodeVertices() and
+    * `indexBytes` bytes of indices (relative to the first vertex) into the
+    * pool.
+    */
+    GeometryRange allocate(const void* vertices, size_t vertexCount,
+                           const void* indices, size_t indexBytes);
+    void release(const GeometryRange& range);
+
+    GLuint vao() const { return VAO; }
+
+private:
+    /* First fit allocator over [0, capacity) */
+    class FreeList {
+    public:
+        FreeList() : capacity(0) {}
+        bool allocate(size_t size, size_t& offset);
+        void release(size_t offset, size_t size);
+        void grow(size_t newCapacity);
+        size_t used() const;
+        size_t ranges() const { return free.size(); }
+
+        size_t capacity;
+    private:
+        std::map<size_t, size_t> free; // offset -> size
+    };
+
+    GeometryPool(VertexLayout layout, bool normals, bool uvs);
+    ~GeometryPool();
+    GeometryPool(const GeometryPool&) = delete;
+
+    void growVertices(size_t minCapacity);
+    void growIndices(size_t minCapacity);
+
+    VertexLayout layout;
+    bool normals, uvs;
+    size_t stride;
+    GLuint VAO, vertexBuffer, indexBuffer;
+    FreeList vertexRanges; // in vertices
+    FreeList indexRanges;  // in bytes
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "util.h"
+#include "mesh_cache.h"
+
+using namespace std;
+using namespace glm;
+
+struct MeshCache::Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMTime;
+    uint64_t sourceHash;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t lodCount;
+    uint32_t hasNormals;
+    uint32_t hasUVs;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+static const char MESH_CACHE_MAGIC[4] = {'P', 'W', 'M', 'C'};
+
+static string cachePath(const string& sourcePath) {
+    return sourcePath + ".meshcache";
+}
+
+// size, modification time and content hash of the source asset
+static bool sourceKey(const string& sourcePath, uint64_t& size, int64_t& mtime, uint64_t& hash) {
+    if (!fileStat(sourcePath, size, mtime)) return false;
+    MappedFile source;
+    if (!source.open(sourcePath)) return false;
+    hash = hashBytes(source.data(), source.size());
+    return true;
+}
+
+static size_t payloadSize(uint32_t vertexCount, uint32_t indexCount, uint32_t lodCount,
+                          bool normals, bool uvs) {
+    return vertexCount * sizeof(vec3) +
+        (normals ? vertexCount * sizeof(vec3) : 0) +
+        (uvs ? vertexCount * sizeof(vec2) : 0) +
+        indexCount * sizeof(unsigned int) +
+        lodCount * sizeof(MeshLod);
+}
+
+MeshCache::MeshCache() : header(nullptr) {}
+
+bool MeshCache::open(const string& sourcePath) {
+    close();
+    if (!file.open(cachePath(sourcePath))) return false;
+
+    const Header* h = reinterpret_cast<const Header*>(file.data());
+    if (file.size() < sizeof(Header) ||
+        memcmp(h->magic, MESH_CACHE_MAGIC, 4) != 0 ||
+        h->version != MESH_CACHE_VERSION ||
+        file.size() != sizeof(Header) +
+            payloadSize(h->vertexCount, h->indexCount, h->lodCount,
+                        h->hasNormals != 0, h->hasUVs != 0)) {
+        close();
+        return false;
+    }
+
+    // cheap checks first, the content hash reads the whole source
+    uint64_t size;
+    int64_t mtime;
+    if (!fileStat(sourcePath, size, mtime) || size != h->sourceSize || mtime != h->sourceMTime) {
+        close();
+        return false;
+    }
+    uint64_t hash;
+    if (!sourceKey(sourcePath, size, mtime, hash) || hash != h->sourceHash) {
+        close();
+        return false;
+    }
+
+    header = h;
+    return true;
+}
+
+void MeshCache::close() {
+    file.close();
+    header = nullptr;
+}
+
+size_t MeshCache::vertexCount() const {
+    return header->vertexCount;
+}
+
+size_t MeshCache::indexCount() const {
+    return header->indexCount;
+}
+
+size_t MeshCache::lodCount() const {
+    return header->lodCount;
+}
+
+const vec3* MeshCache::vertices() const {
+    return reinterpret_cast<const vec3*>(file.data() + sizeof(Header));
+}
+
+const vec3* MeshCache::normals() const {
+    if (!header->hasNormals) return nullptr;
+    return vertices() + header->vertexCount;
+}
+
+const vec2* MeshCache::uvs() const {
+    if (!header->hasUVs) return nullptr;
+    const vec3* after = vertices() + header->vertexCount * (header->hasNormals ? 2 : 1);
+    return reinterpret_cast<const vec2*>(after);
+}
+
+const unsigned int* MeshCache::indices() const {
+    const char* p = file.data() + sizeof(Header) +
+        payloadSize(header->vertexCount, 0, 0, header->hasNormals != 0, header->hasUVs != 0);
+    return reinterpret_cast<const unsigned int*>(p);
+}
+
+const MeshLod* MeshCache::lods() const {
+    return reinterpret_cast<const MeshLod*>(indices() + header->indexCount);
+}
+
+vec3 MeshCache::boundsMin() const {
+    return vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+}
+
+vec3 MeshCache::boundsMax() const {
+    return vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+}
+
+template<typename T>
+static bool writeArray(FILE* fp, const vector<T>& v) {
+    return v.empty() || fwrite(&v[0], sizeof(T), v.size(), fp) == v.size();
+}
+
+void MeshCache::save(
+    const string& sourcePath,
+    const vector<vec3>& vertices,
+    const vector<vec2>& uvs,
+    const vector<vec3>& normals,
+    const vector<unsigned int>& indices,
+    const vector<MeshLod>& lods,
+    const vec3& boundsMin,
+    const vec3& boundsMax) {
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MESH_CACHE_MAGIC, 4);
+    h.version = MESH_CACHE_VERSION;
+    if (!sourceKey(sourcePath, h.sourceSize, h.sourceMTime, h.sourceHash)) return;
+    h.vertexCount = static_cast<uint32_t>(vertices.size());
+    h.indexCount = static_cast<uint32_t>(indices.size());
+    h.lodCount = static_cast<uint32_t>(lods.size());
+    h.hasNormals = normals.size() == vertices.size() && !normals.empty();
+    h.hasUVs = uvs.size() == vertices.size() && !uvs.empty();
+    for (int i = 0; i < 3; i++) {
+        h.boundsMin[i] = boundsMin[i];
+        h.boundsMax[i] = boundsMax[i];
+    }
+
+    // write to a temporary file so a crash never leaves a truncated cache
+    string path = cachePath(sourcePath);
+    string tmpPath = path + ".tmp";
+    FILE* fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp) {
+        cout << "Can't write mesh cache: " << path << endl;
+        return;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 && writeArray(fp, vertices);
+    if (ok && h.hasNormals) ok = writeArray(fp, normals);
+    if (ok && h.hasUVs) ok = writeArray(fp, uvs);
+    if (ok) ok = writeArray(fp, indices);
+    if (ok) ok = writeArray(fp, lods);
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || !replaceFile(tmpPath, path)) {
+        remove(tmpPath.c_str());
+        cout << "Can't write mesh cache: " << path << endl;
+        return;
+    }
+    cout << "Saved mesh cache: " << path << endl;
+}
@@ -0,0 +1,57 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "mapped_file.h"
+#include "mesh_simplifier.h"
+
+/**
+* Binary cache of an indexed mesh (vertices, normals, UVs, indices, LOD
+* ranges and bounds), stored next to the source asset as <source>.meshcache.
+* A cache is only used if it was built from a source file with the same size,
+* modification time and content hash, and by the same MESH_CACHE_VERSION.
+*/
+#define MESH_CACHE_VERSION 5
+
+class MeshCache {
+public:
+    MeshCache();
+
+    /* Maps the cache of `sourcePath`, returns false if it's missing or stale */
+    bool open(const std::string& sourcePath);
+    void close();
+
+    size_t vertexCount() const;
+    size_t indexCount() const;
+    size_t lodCount() const;
+    /* Point into the mapped file, normals()/uvs() are nullptr if not stored */
+    const glm::vec3* vertices() const;
+    const glm::vec3* normals() const;
+    const glm::vec2* uvs() const;
+    const unsigned int* indices() const;
+    const MeshLod* lods() const;
+    glm::vec3 boundsMin() const;
+    glm::vec3 boundsMax() const;
+
+    /* Writes the cache of `sourcePath`, failures are only reported */
+    static void save(
+        const std::string& sourcePath,
+        const std::vector<glm::vec3>& vertices,
+        const std::vector<glm::vec2>& uvs,
+        const std::vector<glm::vec3>& normals,
+        const std::vector<unsigned int>& indices,
+        const std::vector<MeshLod>& lods,
+        const glm::vec3& boundsMin,
+        const glm::vec3& boundsMax
+    );
+
+private:
+    struct Header;
+    MappedFile file;
+    const Header* header;
+};
+
+#endif
@@ -0,0 +1,406 @@
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include "parallel.h"
+#include "mesh_indexer.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// 32 byte key, same layout as PackedVertex in model.cpp
+struct Corner {
+    vec3 position;
+    vec2 uv;
+    vec3 normal;
+};
+static_assert(sizeof(Corner) == 32, "Corner must not contain padding");
+
+struct Slot {
+    uint32_t hash;
+    uint32_t index; // output index + 1, 0 = empty
+};
+
+inline uint64_t mix(uint64_t h, uint64_t k) {
+    k *= 0x87c37b91114253d5ULL;
+    k = (k << 31) | (k >> 33);
+    k *= 0x4cf5ad432745937fULL;
+    h ^= k;
+    return ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+}
+
+inline uint32_t hashCorner(const Corner& c) {
+    uint64_t w[4];
+    memcpy(w, &c, sizeof(w));
+    uint64_t h = mix(mix(mix(mix(0, w[0]), w[1]), w[2]), w[3]);
+    // murmur3 finalizer, all key bits affect the low bits used for slots
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h);
+}
+
+size_t tableSize(size_t unique) {
+    // keep the load factor at or below 1/2
+    size_t n = 16;
+    while (n < unique * 2) n <<= 1;
+    return n;
+}
+
+inline Corner makeCorner(const vec3* positions, const vec2* uvs, const vec3* normals, size_t i) {
+    Corner c;
+    c.position = positions[i];
+    c.uv = uvs ? uvs[i] : vec2();
+    c.normal = normals ? normals[i] : vec3();
+    return c;
+}
+
+// (vertex, normal, texcoord) key of indexTriples()
+struct Triple {
+    int key[3];
+};
+
+inline uint32_t hashTriple(const int key[3]) {
+    uint64_t h = mix(mix(0, static_cast<uint32_t>(key[0])),
+                     (static_cast<uint64_t>(static_cast<uint32_t>(key[1])) << 32) |
+                     static_cast<uint32_t>(key[2]));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h);
+}
+
+// shards of the parallel indexer, selected by the high hash bits
+const unsigned int SHARD_BITS = 6;
+const size_t SHARDS = size_t(1) << SHARD_BITS;
+
+size_t parallelThreshold = 1 << 20;
+
+}
+
+void setParallelIndexingThreshold(size_t corners) {
+    parallelThreshold = corners;
+}
+
+size_t getParallelIndexingThreshold() {
+    return parallelThreshold;
+}
+
+/**
+* Steps 1 and 2 of the sharded indexers, `first[i]` is set to the first of
+* the `count` keys equal to key i (keyOf(i), compared bitwise):
+* 1. hash all keys and bucket them by shard, keeping their order
+* 2. per shard, find the first occurrence of every key
+*/
+template<typename Key, typename KeyOf, typename HashOf>
+static void findFirstOccurrences(size_t count, size_t chunks, KeyOf keyOf, HashOf hashOf,
+                                 vector<uint32_t>& first) {
+    vector<uint32_t> hashes(count);
+    vector<size_t> shardCounts(chunks * SHARDS, 0);
+    auto chunkBegin = [&](size_t c) { return count * c / chunks; };
+
+    parallelFor(chunks, [&](size_t c) {
+        size_t* counts = &shardCounts[c * SHARDS];
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); i++) {
+            hashes[i] = hashOf(keyOf(i));
+            counts[hashes[i] >> (32 - SHARD_BITS)]++;
+        }
+    });
+
+    // offsets of every (shard, chunk) range, shards are contiguous
+    vector<size_t> shardBegin(SHARDS + 1, 0);
+    size_t offset = 0;
+    for (size_t s = 0; s < SHARDS; s++) {
+        shardBegin[s] = offset;
+        for (size_t c = 0; c < chunks; c++) {
+            size_t n = shardCounts[c * SHARDS + s];
+            shardCounts[c * SHARDS + s] = offset;
+            offset += n;
+        }
+    }
+    shardBegin[SHARDS] = offset;
+
+    vector<uint32_t> bucketed(count);
+    parallelFor(chunks, [&](size_t c) {
+        size_t* next = &shardCounts[c * SHARDS];
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); i++) {
+            bucketed[next[hashes[i] >> (32 - SHARD_BITS)]++] = static_cast<uint32_t>(i);
+        }
+    });
+
+    first.resize(count);
+    parallelFor(SHARDS, [&](size_t s) {
+        size_t n = shardBegin[s + 1] - shardBegin[s];
+        vector<Slot> table(tableSize(n / 4 + 1), Slot{0, 0});
+        size_t mask = table.size() - 1;
+        size_t used = 0;
+        for (size_t b = shardBegin[s]; b < shardBegin[s + 1]; b++) {
+            uint32_t i = bucketed[b];
+            uint32_t hash = hashes[i];
+            Key key = keyOf(i);
+
+            size_t k = hash & mask;
+            while (table[k].index != 0) {
+                if (table[k].hash == hash) {
+                    Key other = keyOf(table[k].index - 1);
+                    if (memcmp(&other, &key, sizeof(Key)) == 0) break;
+                }
+                k = (k + 1) & mask;
+            }
+            if (table[k].index != 0) {
+                first[i] = table[k].index - 1;
+                continue;
+            }
+
+            first[i] = i;
+            table[k].hash = hash;
+            table[k].index = i + 1;
+            if (++used * 2 > table.size()) {
+                vector<Slot> grown(table.size() * 2, Slot{0, 0});
+                size_t grownMask = grown.size() - 1;
+                for (const Slot& slot : table) {
+                    if (slot.index == 0) continue;
+                    size_t t = slot.hash & grownMask;
+                    while (grown[t].index != 0) t = (t + 1) & grownMask;
+                    grown[t] = slot;
+                }
+                table.swap(grown);
+                mask = grownMask;
+            }
+        }
+    });
+}
+
+/**
+* Step 3: numbers the first occurrences in key order with a prefix sum,
+* `number[i]` is the output index of key i. Returns the number of unique keys.
+*/
+static size_t numberFirstOccurrences(const vector<uint32_t>& first, size_t chunks,
+                                     vector<uint32_t>& number) {
+    size_t count = first.size();
+    auto chunkBegin = [&](size_t c) { return count * c / chunks; };
+
+    vector<size_t> chunkUnique(chunks + 1, 0);
+    parallelFor(chunks, [&](size_t c) {
+        size_t n = 0;
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); i++) {
+            if (first[i] == i) n++;
+        }
+        chunkUnique[c + 1] = n;
+    });
+    for (size_t c = 0; c < chunks; c++) chunkUnique[c + 1] += chunkUnique[c];
+
+    // first occurrences before duplicates, which may refer to an earlier chunk
+    number.resize(count);
+    parallelFor(chunks, [&](size_t c) {
+        uint32_t next = static_cast<uint32_t>(chunkUnique[c]);
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); i++) {
+            if (first[i] == i) number[i] = next++;
+        }
+    });
+    parallelFor(chunks, [&](size_t c) {
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); i++) {
+            if (first[i] != i) number[i] = number[first[i]];
+        }
+    });
+    return chunkUnique[chunks];
+}
+
+/* Sharded version of the loop in indexVertices(), gives the same result */
+static void indexVerticesSharded(
+    const vec3* positions,
+    const vec2* uvs,
+    const vec3* normals,
+    size_t count,
+    vector<unsigned int>& out_indices,
+    vector<vec3>& out_vertices,
+    vector<vec2>& out_uvs,
+    vector<vec3>& out_normals) {
+    size_t chunks = workerCount();
+    auto chunkBegin = [&](size_t c) { return count * c / chunks; };
+
+    vector<uint32_t> first, number;
+    findFirstOccurrences<Corner>(count, chunks,
+        [&](size_t i) { return makeCorner(positions, uvs, normals, i); },
+        [](const Corner& c) { return hashCorner(c); }, first);
+    size_t unique = numberFirstOccurrences(first, chunks, number);
+
+    unsigned int base = static_cast<unsigned int>(out_vertices.size());
+    size_t indexBase = out_indices.size();
+    out_indices.resize(indexBase + count);
+    out_vertices.resize(base + unique);
+    if (uvs) out_uvs.resize(out_uvs.size() + unique);
+    if (normals) out_normals.resize(out_normals.size() + unique);
+    vec2* uvOut = uvs ? &out_uvs[out_uvs.size() - unique] : nullptr;
+    vec3* normalOut = normals ? &out_normals[out_normals.size() - unique] : nullptr;
+
+    parallelFor(chunks, [&](size_t c) {
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); i++) {
+            out_indices[indexBase + i] = base + number[i];
+            if (first[i] != i) continue;
+            out_vertices[base + number[i]] = positions[i];
+            if (uvOut) uvOut[number[i]] = uvs[i];
+            if (normalOut) normalOut[number[i]] = normals[i];
+        }
+    });
+}
+
+void indexVertices(
+    const vec3* positions,
+    const vec2* uvs,
+    const vec3* normals,
+    size_t count,
+    vector<unsigned int>& out_indices,
+    vector<vec3>& out_vertices,
+    vector<vec2>& out_uvs,
+    vector<vec3>& out_normals,
+    size_t uniqueHint) {
+    if (count >= parallelThreshold && workerCount() > 1 &&
+        count <= numeric_limits<uint32_t>::max()) {
+        indexVerticesSharded(positions, uvs, normals, count,
+                             out_indices, out_vertices, out_uvs, out_normals);
+        return;
+    }
+
+    // closed triangle meshes have ~count / 6 unique corners, leave some slack
+    if (uniqueHint == 0) uniqueHint = count / 4;
+    if (uniqueHint > count) uniqueHint = count;
+
+    // unique corners found by this call, compared against instead of out_XXXX
+    vector<Corner> unique;
+    unique.reserve(uniqueHint);
+    vector<Slot> table(tableSize(uniqueHint), Slot{0, 0});
+    size_t mask = table.size() - 1;
+    unsigned int base = static_cast<unsigned int>(out_vertices.size());
+
+    out_indices.reserve(out_indices.size() + count);
+    for (size_t i = 0; i < count; i++) {
+        Corner c = makeCorner(positions, uvs, normals, i);
+        uint32_t hash = hashCorner(c);
+
+        size_t s = hash & mask;
+        while (table[s].index != 0) {
+            if (table[s].hash == hash &&
+                memcmp(&unique[table[s].index - 1], &c, sizeof(Corner)) == 0) {
+                break;
+            }
+            s = (s + 1) & mask;
+        }
+        if (table[s].index != 0) {
+            out_indices.push_back(base + table[s].index - 1);
+            continue;
+        }
+
+        unique.push_back(c);
+        table[s].hash = hash;
+        table[s].index = static_cast<uint32_t>(unique.size());
+        out_indices.push_back(base + static_cast<unsigned int>(unique.size()) - 1);
+
+        if (unique.size() * 2 > table.size()) {
+            vector<Slot> grown(table.size() * 2, Slot{0, 0});
+            size_t grownMask = grown.size() - 1;
+            for (const Slot& slot : table) {
+                if (slot.index == 0) continue;
+                size_t t = slot.hash & grownMask;
+                while (grown[t].index != 0) t = (t + 1) & grownMask;
+                grown[t] = slot;
+            }
+            table.swap(grown);
+            mask = grownMask;
+        }
+    }
+
+    out_vertices.reserve(out_vertices.size() + unique.size());
+    if (uvs) out_uvs.reserve(out_uvs.size() + unique.size());
+    if (normals) out_normals.reserve(out_normals.size() + unique.size());
+    for (const Corner& c : unique) {
+        out_vertices.push_back(c.position);
+        if (uvs) out_uvs.push_back(c.uv);
+        if (normals) out_normals.push_back(c.normal);
+    }
+}
+
+/*****************************************************************************/
+
+static size_t tripleSlot(const int key[3], size_t mask) {
+    return hashTriple(key) & mask;
+}
+
+IndexTripleMap::IndexTripleMap(size_t expected)
+    : table(tableSize(expected)), count(0) {
+    for (auto& slot : table) slot.index = 0;
+}
+
+unsigned int IndexTripleMap::insert(int vertex, int normal, int texcoord, bool& inserted) {
+    const int key[3] = {vertex, normal, texcoord};
+    size_t mask = table.size() - 1;
+    size_t s = tripleSlot(key, mask);
+    while (table[s].index != 0) {
+        if (table[s].key[0] == vertex && table[s].key[1] == normal &&
+            table[s].key[2] == texcoord) {
+            inserted = false;
+            return table[s].index - 1;
+        }
+        s = (s + 1) & mask;
+    }
+
+    inserted = true;
+    table[s].key[0] = vertex;
+    table[s].key[1] = normal;
+    table[s].key[2] = texcoord;
+    table[s].index = static_cast<unsigned int>(++count);
+    if (count * 2 > table.size()) grow();
+    return static_cast<unsigned int>(count - 1);
+}
+
+void IndexTripleMap::grow() {
+    vector<Slot> grown(table.size() * 2);
+    for (auto& slot : grown) slot.index = 0;
+    size_t mask = grown.size() - 1;
+    for (const Slot& slot : table) {
+        if (slot.index == 0) continue;
+        size_t s = tripleSlot(slot.key, mask);
+        while (grown[s].index != 0) s = (s + 1) & mask;
+        grown[s] = slot;
+    }
+    table.swap(grown);
+}
+
+void indexTriples(
+    const int* triples,
+    size_t count,
+    vector<unsigned int>& out_indices,
+    vector<unsigned int>& out_firsts) {
+    out_indices.resize(count);
+    if (count >= parallelThreshold && workerCount() > 1 &&
+        count <= numeric_limits<uint32_t>::max()) {
+        size_t chunks = workerCount();
+        vector<uint32_t> first, number;
+        findFirstOccurrences<Triple>(count, chunks,
+            [&](size_t i) { Triple t; memcpy(t.key, triples + 3 * i, sizeof(t.key)); return t; },
+            [](const Triple& t) { return hashTriple(t.key); }, first);
+        out_firsts.resize(numberFirstOccurrences(first, chunks, number));
+        auto chunkBegin = [&](size_t c) { return count * c / chunks; };
+        parallelFor(chunks, [&](size_t c) {
+            for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); i++) {
+                out_indices[i] = number[i];
+                if (first[i] == i) out_firsts[number[i]] = static_cast<unsigned int>(i);
+            }
+        });
+        return;
+    }
+
+    out_firsts.clear();
+    IndexTripleMap map(count / 4);
+    for (size_t i = 0; i < count; i++) {
+        const int* t = triples + 3 * i;
+        bool inserted;
+        out_indices[i] = map.insert(t[0], t[1], t[2], inserted);
+        if (inserted) out_firsts.push_back(static_cast<unsigned int>(i));
+    }
+}
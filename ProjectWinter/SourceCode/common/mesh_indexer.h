@@ -0,0 +1,79 @@
+#ifndef MESH_INDEXER_H
+#define MESH_INDEXER_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/**
+* Removes duplicate (position, uv, normal) corners using a flat open
+* addressing hash table. Two corners are the same if they are bitwise equal.
+* Unique corners are appended to out_XXXX in order of first occurrence, so the
+* result is the same as the std::map based indexVBO. `uvs` and `normals` may be
+* nullptr, in which case out_uvs/out_normals are left untouched. `uniqueHint`
+* is the expected number of unique corners (0 = `count` / 4); the table grows
+* if the hint is too small.
+*
+* Meshes with at least getParallelIndexingThreshold() corners are indexed on
+* workerCount() threads: corners are hashed into shards that are deduplicated
+* in parallel, then renumbered with a prefix sum. The output is identical.
+*/
+void indexVertices(
+    const glm::vec3* positions,
+    const glm::vec2* uvs,
+    const glm::vec3* normals,
+    size_t count,
+    std::vector<unsigned int>& out_indices,
+    std::vector<glm::vec3>& out_vertices,
+    std::vector<glm::vec2>& out_uvs,
+    std::vector<glm::vec3>& out_normals,
+    size_t uniqueHint = 0
+);
+
+/* Corner count above which indexVertices() and indexTriples() run in parallel,
+default 1M */
+void setParallelIndexingThreshold(size_t corners);
+size_t getParallelIndexingThreshold();
+
+/**
+* Maps (vertex_index, normal_index, texcoord_index) triples of an indexed
+* format (e.g. OBJ) to output vertex indices, numbered 0, 1, 2, ... in order
+* of first insertion. Used to build indexed arrays straight from the file
+* indices, without expanding every corner first.
+*/
+class IndexTripleMap {
+public:
+    /* `expected` is the expected number of unique triples */
+    IndexTripleMap(size_t expected = 0);
+
+    /* Index of the triple, `inserted` is set if it wasn't seen before */
+    unsigned int insert(int vertex, int normal, int texcoord, bool& inserted);
+
+    size_t size() const { return count; }
+
+private:
+    struct Slot {
+        int key[3];
+        unsigned int index; // output index + 1, 0 = empty
+    };
+    std::vector<Slot> table;
+    size_t count;
+
+    void grow();
+};
+
+/**
+* Numbers the distinct (vertex, normal, texcoord) triples of `count` corners
+* (3 ints each, e.g. tinyobj::index_t) in order of first occurrence, like
+* IndexTripleMap: out_indices[i] is the number of corner i and out_firsts[k]
+* the first corner numbered k, whose attributes become vertex k. Runs sharded
+* like indexVertices() above the same threshold, with identical output.
+*/
+void indexTriples(
+    const int* triples,
+    size_t count,
+    std::vector<unsigned int>& out_indices,
+    std::vector<unsigned int>& out_firsts
+);
+
+#endif
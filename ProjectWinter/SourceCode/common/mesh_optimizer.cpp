@@ -0,0 +1,200 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "mesh_optimizer.h"
+
+using namespace std;
+using namespace glm;
+
+// FIFO cache, returns the misses of each triangle
+static vector<unsigned char> simulateCache(
+    const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize) {
+    vector<size_t> cachedAt(vertexCount, 0); // misses so far when it was cached, 0 = never
+    size_t fifo = 0;
+    vector<unsigned char> misses(indices.size() / 3, 0);
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        // evicted once cacheSize newer vertices went in after it
+        if (cachedAt[v] == 0 || fifo - cachedAt[v] >= cacheSize) {
+            cachedAt[v] = ++fifo;
+            misses[i / 3]++;
+        }
+    }
+    return misses;
+}
+
+float computeACMR(const vector<unsigned int>& indices, size_t vertexCount,
+                  unsigned int cacheSize) {
+    if (indices.size() < 3) return 0.0f;
+    vector<unsigned char> misses = simulateCache(indices, vertexCount, cacheSize);
+    size_t total = 0;
+    for (unsigned char m : misses) total += m;
+    return static_cast<float>(total) / misses.size();
+}
+
+void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount,
+                         unsigned int cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    if (indices.size() % 3 != 0 || triangleCount == 0) return;
+
+    // vertex -> triangles, in CSR form
+    vector<unsigned int> live(vertexCount, 0);
+    for (unsigned int v : indices) live[v]++;
+    vector<size_t> adjacencyBegin(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) adjacencyBegin[v + 1] = adjacencyBegin[v] + live[v];
+    vector<unsigned int> adjacency(indices.size());
+    vector<size_t> fill(adjacencyBegin.begin(), adjacencyBegin.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    vector<size_t> cacheTime(vertexCount, 0);
+    vector<bool> emitted(triangleCount, false);
+    vector<unsigned int> deadEnd;
+    vector<unsigned int> candidates;
+    vector<unsigned int> output;
+    output.reserve(indices.size());
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+
+    long long fanning = indices[0];
+    while (fanning >= 0) {
+        unsigned int f = static_cast<unsigned int>(fanning);
+        candidates.clear();
+        for (size_t a = adjacencyBegin[f]; a < adjacencyBegin[f + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * t + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+            }
+        }
+
+        // the candidate still in the cache the longest that will stay there
+        fanning = -1;
+        size_t best = 0;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+            size_t priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize) priority = time - cacheTime[v];
+            if (fanning < 0 || priority > best) {
+                best = priority;
+                fanning = v;
+            }
+        }
+
+        // dead end, go back to a recent vertex or to the next unused one
+        while (fanning < 0 && !deadEnd.empty()) {
+            unsigned int d = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[d] > 0) fanning = d;
+        }
+        while (fanning < 0 && cursor < vertexCount) {
+            if (live[cursor] > 0) fanning = cursor;
+            cursor++;
+        }
+    }
+
+    indices.swap(output);
+}
+
+void optimizeOverdraw(vector<unsigned int>& indices, const vector<vec3>& positions,
+                      unsigned int cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    if (indices.size() % 3 != 0 || triangleCount == 0) return;
+
+    // clusters start at triangles that miss on all 3 vertices
+    vector<unsigned char> misses = simulateCache(indices, positions.size(), cacheSize);
+    vector<size_t> clusterBegin;
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (t == 0 || misses[t] == 3) clusterBegin.push_back(t);
+    }
+    clusterBegin.push_back(triangleCount);
+    size_t clusterCount = clusterBegin.size() - 1;
+    if (clusterCount < 2) return;
+
+    // area weighted centroid and normal of the mesh and each cluster
+    vector<vec3> centroids(clusterCount), normals(clusterCount);
+    vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterBegin[c]; t < clusterBegin[c + 1]; t++) {
+            const vec3& a = positions[indices[3 * t + 0]];
+            const vec3& b = positions[indices[3 * t + 1]];
+            const vec3& d = positions[indices[3 * t + 2]];
+            vec3 n = cross(b - a, d - a);
+            float triangleArea = length(n);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[c] = area > 0.0f ? centroid / area : centroid;
+        float len = length(normal);
+        normals[c] = len > 0.0f ? normal / len : normal;
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    vector<float> key(clusterCount);
+    vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        key[c] = dot(centroids[c] - meshCentroid, normals[c]);
+        order[c] = c;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return key[a] > key[b];
+    });
+
+    vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (size_t c : order) {
+        output.insert(output.end(), indices.begin() + 3 * clusterBegin[c],
+                      indices.begin() + 3 * clusterBegin[c + 1]);
+    }
+    indices.swap(output);
+}
+
+template<typename T>
+static void remap(vector<T>& data, const vector<unsigned int>& newIndex, size_t newCount) {
+    if (data.empty()) return;
+    vector<T> remapped(newCount);
+    for (size_t v = 0; v < data.size(); v++) {
+        if (newIndex[v] != ~0u) remapped[newIndex[v]] = data[v];
+    }
+    data.swap(remapped);
+}
+
+void optimizeVertexFetch(vector<unsigned int>& indices, vector<vec3>& positions,
+                         vector<vec3>& normals, vector<vec2>& uvs) {
+    vector<unsigned int> newIndex(positions.size(), ~0u);
+    unsigned int next = 0;
+    for (unsigned int& i : indices) {
+        if (newIndex[i] == ~0u) newIndex[i] = next++;
+        i = newIndex[i];
+    }
+    remap(positions, newIndex, next);
+    remap(normals, newIndex, next);
+    remap(uvs, newIndex, next);
+}
+
+void optimizeMesh(const string& name, vector<vec3>& positions, vector<vec3>& normals,
+                  vector<vec2>& uvs, vector<unsigned int>& indices) {
+    if (indices.size() % 3 != 0 || indices.empty()) return;
+
+    float before = computeACMR(indices, positions.size());
+    optimizeVertexCache(indices, positions.size());
+    optimizeOverdraw(indices, positions);
+    optimizeVertexFetch(indices, positions, normals, uvs);
+    float after = computeACMR(indices, positions.size());
+
+    cout << "Optimized " << name << ": ACMR " << fixed << setprecision(3)
+        << before << " -> " << after << defaultfloat << endl;
+}
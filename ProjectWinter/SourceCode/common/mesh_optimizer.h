@@ -0,0 +1,53 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Reordering passes for indexed triangle lists. None of them changes what is
+* drawn, only the order of the triangles and vertices. Index buffers whose
+* size isn't a multiple of 3 are left untouched.
+*/
+
+/* Average cache misses per triangle of a FIFO post-transform cache */
+float computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount,
+                  unsigned int cacheSize = 16);
+
+/**
+* Reorders the triangles for post-transform cache reuse (Tipsify, Sander et
+* al. 2007). The winding of every triangle is kept.
+*/
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+                         unsigned int cacheSize = 16);
+
+/**
+* Splits the triangles into clusters where the cache restarts (3 misses in a
+* row) and sorts the clusters so that the ones facing away from the mesh
+* center come first, which reduces overdraw for any view direction. Run
+* after optimizeVertexCache(), whose ACMR it mostly keeps.
+*/
+void optimizeOverdraw(std::vector<unsigned int>& indices,
+                      const std::vector<glm::vec3>& positions,
+                      unsigned int cacheSize = 16);
+
+/**
+* Renumbers the vertices in order of first use and drops unused ones.
+* `normals`/`uvs` may be empty.
+*/
+void optimizeVertexFetch(std::vector<unsigned int>& indices,
+                         std::vector<glm::vec3>& positions,
+                         std::vector<glm::vec3>& normals,
+                         std::vector<glm::vec2>& uvs);
+
+/**
+* All of the above, printing the ACMR of `name` before and after.
+*/
+void optimizeMesh(const std::string& name,
+                  std::vector<glm::vec3>& positions,
+                  std::vector<glm::vec3>& normals,
+                  std::vector<glm::vec2>& uvs,
+                  std::vector<unsigned int>& indices);
+
+#endif
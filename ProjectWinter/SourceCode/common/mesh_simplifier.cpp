@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+using namespace std;
+using namespace glm;
+
+// sum of squared distances to a set of weighted planes
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22, b0, b1, b2, c, weight;
+
+    Quadric() { memset(this, 0, sizeof(*this)); }
+
+    void addPlane(const dvec3& n, double d, double w) {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    // weighted mean squared distance of `p` to the planes
+    double error(const vec3& p) const {
+        if (weight <= 0.0) return 0.0;
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + a11 * y * y + a22 * z * z +
+            2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+            2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(e, 0.0) / weight;
+    }
+};
+
+enum VertexKind : unsigned char { Manifold, Border, Locked };
+
+// border planes count more than surface planes, as in most QEM implementations
+static const double BORDER_WEIGHT = 10.0;
+static const float NORMAL_COS_LIMIT = 0.7f;
+
+static uint64_t edgeKey(unsigned int a, unsigned int b) {
+    return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+// directed edges between canonical vertices, sorted for binary_search
+static vector<uint64_t> directedEdges(const vector<unsigned int>& indices,
+                                      const vector<unsigned int>& canon) {
+    vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t < indices.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            edges.push_back(edgeKey(canon[indices[t + k]], canon[indices[t + (k + 1) % 3]]));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    return edges;
+}
+
+static bool hasEdge(const vector<uint64_t>& edges, unsigned int a, unsigned int b) {
+    return binary_search(edges.begin(), edges.end(), edgeKey(a, b));
+}
+
+// the edge a-b belongs to a single triangle
+static bool isOpen(const vector<uint64_t>& edges, unsigned int a, unsigned int b) {
+    return hasEdge(edges, a, b) != hasEdge(edges, b, a);
+}
+
+struct Collapse {
+    unsigned int from, to;
+    double error;
+};
+
+vector<unsigned int> simplifyMesh(
+    const vector<unsigned int>& indices,
+    const vector<vec3>& positions,
+    const vector<vec3>& normals,
+    size_t targetIndexCount,
+    float targetError,
+    float* resultError) {
+    size_t vertexCount = positions.size();
+    bool useNormals = normals.size() == vertexCount;
+    vector<unsigned int> result(indices);
+    if (resultError) *resultError = 0.0f;
+    if (indices.size() % 3 != 0 || result.size() <= targetIndexCount) return result;
+
+    // vertices with bitwise equal positions share a canonical vertex
+    vector<unsigned int> order(vertexCount), canon(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) order[v] = static_cast<unsigned int>(v);
+    auto positionLess = [&](unsigned int a, unsigned int b) {
+        return memcmp(&positions[a], &positions[b], sizeof(vec3)) < 0;
+    };
+    sort(order.begin(), order.end(), positionLess);
+    vector<unsigned int> wedges(vertexCount, 0);
+    for (size_t i = 0; i < vertexCount; i++) {
+        bool same = i > 0 && !positionLess(order[i - 1], order[i]);
+        canon[order[i]] = same ? canon[order[i - 1]] : order[i];
+        wedges[canon[order[i]]]++;
+    }
+
+    // seams and complex borders are locked, simple borders slide along the border
+    vector<uint64_t> edges = directedEdges(result, canon);
+    vector<unsigned int> openEdges(vertexCount, 0);
+    for (size_t t = 0; t < result.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = canon[result[t + k]], b = canon[result[t + (k + 1) % 3]];
+            if (!hasEdge(edges, b, a)) {
+                openEdges[a]++;
+                openEdges[b]++;
+            }
+        }
+    }
+    vector<VertexKind> kind(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        unsigned int c = canon[v];
+        if (wedges[c] > 1 || (openEdges[c] != 0 && openEdges[c] != 2)) kind[v] = Locked;
+        else kind[v] = openEdges[c] == 0 ? Manifold : Border;
+    }
+
+    vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t < result.size(); t += 3) {
+        const vec3& p0 = positions[result[t]];
+        const vec3& p1 = positions[result[t + 1]];
+        const vec3& p2 = positions[result[t + 2]];
+        dvec3 n = cross(dvec3(p1 - p0), dvec3(p2 - p0));
+        double area = length(n);
+        if (area == 0.0) continue;
+        n /= area;
+        for (int k = 0; k < 3; k++) {
+            quadrics[result[t + k]].addPlane(n, -dot(n, dvec3(p0)), area * 0.5);
+        }
+        // plane through each open edge, perpendicular to the triangle
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = result[t + k], b = result[t + (k + 1) % 3];
+            if (hasEdge(edges, canon[b], canon[a])) continue;
+            dvec3 edge = dvec3(positions[b] - positions[a]);
+            double len = length(edge);
+            if (len == 0.0) continue;
+            dvec3 en = cross(edge / len, n);
+            double d = -dot(en, dvec3(positions[a]));
+            quadrics[a].addPlane(en, d, len * len * BORDER_WEIGHT);
+            quadrics[b].addPlane(en, d, len * len * BORDER_WEIGHT);
+        }
+    }
+
+    double errorLimit = static_cast<double>(targetError) * targetError;
+    double maxError = 0.0;
+    vector<unsigned int> remap(vertexCount);
+    vector<bool> touched(vertexCount);
+    vector<size_t> adjacencyBegin(vertexCount + 1);
+    vector<unsigned int> adjacency;
+    vector<Collapse> collapses;
+    vector<unsigned int> neighbours;
+
+    while (result.size() > targetIndexCount) {
+        // vertex -> triangles of the current mesh
+        fill(adjacencyBegin.begin(), adjacencyBegin.end(), 0);
+        for (unsigned int v : result) adjacencyBegin[v + 1]++;
+        for (size_t v = 0; v < vertexCount; v++) adjacencyBegin[v + 1] += adjacencyBegin[v];
+        adjacency.resize(result.size());
+        vector<size_t> cursor(adjacencyBegin.begin(), adjacencyBegin.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) {
+            adjacency[cursor[result[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+        edges = directedEdges(result, canon);
+
+        // cheapest collapse of every vertex that may move
+        collapses.clear();
+        for (size_t v = 0; v < vertexCount; v++) {
+            if (kind[v] == Locked || adjacencyBegin[v] == adjacencyBegin[v + 1]) continue;
+            neighbours.clear();
+            for (size_t a = adjacencyBegin[v]; a < adjacencyBegin[v + 1]; a++) {
+                size_t t = 3 * adjacency[a];
+                for (int k = 0; k < 3; k++) {
+                    if (result[t + k] != v) neighbours.push_back(result[t + k]);
+                }
+            }
+            sort(neighbours.begin(), neighbours.end());
+            neighbours.erase(unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+            // touching two wedges of one position would tear the seam
+            bool seamConflict = false;
+            for (size_t i = 0; i < neighbours.size() && !seamConflict; i++) {
+                for (size_t j = i + 1; j < neighbours.size(); j++) {
+                    if (canon[neighbours[i]] == canon[neighbours[j]]) {
+                        seamConflict = true;
+                        break;
+                    }
+                }
+            }
+            if (seamConflict) continue;
+
+            Collapse best = {0, 0, -1.0};
+            for (unsigned int n : neighbours) {
+                if (kind[v] == Border && !isOpen(edges, canon[v], canon[n])) continue;
+                if (useNormals && dot(normals[v], normals[n]) < NORMAL_COS_LIMIT) continue;
+                double e = quadrics[v].error(positions[n]);
+                if (best.error < 0.0 || e < best.error) best = {static_cast<unsigned int>(v), n, e};
+            }
+            if (best.error >= 0.0 && best.error <= errorLimit) collapses.push_back(best);
+        }
+        if (collapses.empty()) break;
+        sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+
+        // collapse independent vertices, cheapest first; the expensive half
+        // waits for the next pass, where cheaper collapses may have appeared
+        double passLimit = collapses[collapses.size() / 2].error;
+        for (size_t v = 0; v < vertexCount; v++) remap[v] = static_cast<unsigned int>(v);
+        fill(touched.begin(), touched.end(), false);
+        size_t triangles = result.size() / 3, targetTriangles = targetIndexCount / 3;
+        size_t collapsed = 0;
+        for (const Collapse& c : collapses) {
+            if (triangles <= targetTriangles || c.error > passLimit) break;
+            if (touched[c.from] || touched[c.to]) continue;
+
+            // reject collapses that flip a triangle
+            bool flips = false;
+            size_t removed = 0;
+            for (size_t a = adjacencyBegin[c.from]; a < adjacencyBegin[c.from + 1] && !flips; a++) {
+                size_t t = 3 * adjacency[a];
+                vec3 p[3];
+                bool degenerate = false;
+                for (int k = 0; k < 3; k++) {
+                    unsigned int v = result[t + k];
+                    if (v != c.from && canon[v] == canon[c.to]) degenerate = true;
+                    p[k] = positions[v];
+                }
+                if (degenerate) {
+                    removed++;
+                    continue;
+                }
+                vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+                for (int k = 0; k < 3; k++) {
+                    if (result[t + k] == c.from) p[k] = positions[c.to];
+                }
+                vec3 after = cross(p[1] - p[0], p[2] - p[0]);
+                if (dot(before, after) <= 0.0f) flips = true;
+            }
+            if (flips) continue;
+
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            for (size_t a = adjacencyBegin[c.from]; a < adjacencyBegin[c.from + 1]; a++) {
+                size_t t = 3 * adjacency[a];
+                for (int k = 0; k < 3; k++) touched[result[t + k]] = true;
+            }
+            triangles -= std::min(removed, triangles);
+            maxError = std::max(maxError, c.error);
+            collapsed++;
+        }
+        if (collapsed == 0) break;
+
+        // apply the pass, dropping triangles that became degenerate
+        size_t out = 0;
+        for (size_t t = 0; t < result.size(); t += 3) {
+            unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+            if (canon[a] == canon[b] || canon[b] == canon[c] || canon[a] == canon[c]) continue;
+            result[out++] = a;
+            result[out++] = b;
+            result[out++] = c;
+        }
+        result.resize(out);
+    }
+
+    if (resultError) *resultError = static_cast<float>(sqrt(maxError));
+    return result;
+}
+
+vector<MeshLod> buildLodChain(
+    vector<unsigned int>& indices,
+    const vector<vec3>& positions,
+    const vector<vec3>& normals,
+    size_t maxLevels,
+    size_t minTriangles,
+    float maxError) {
+    vector<MeshLod> lods;
+    lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f});
+    if (positions.empty() || indices.size() % 3 != 0) return lods;
+
+    vec3 boundsMin = positions[0], boundsMax = positions[0];
+    for (const vec3& p : positions) {
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+    float errorLimit = maxError * length(boundsMax - boundsMin);
+
+    vector<unsigned int> level(indices);
+    float error = 0.0f;
+    while (lods.size() < maxLevels) {
+        size_t target = level.size() / 6 * 3;
+        if (target / 3 < minTriangles || error >= errorLimit) break;
+
+        float levelError;
+        vector<unsigned int> next =
+            simplifyMesh(level, positions, normals, target, errorLimit - error, &levelError);
+        // stop once collapses run out (locked seams, error limit)
+        if (next.empty() || next.size() * 10 > level.size() * 9) break;
+
+        // each level is simplified from the previous one, so errors add up
+        error += levelError;
+        optimizeVertexCache(next, positions.size());
+        lods.push_back({static_cast<uint32_t>(indices.size()),
+                        static_cast<uint32_t>(next.size()), error});
+        indices.insert(indices.end(), next.begin(), next.end());
+        level.swap(next);
+    }
+    return lods;
+}
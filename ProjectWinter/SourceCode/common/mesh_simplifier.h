@@ -0,0 +1,50 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/* A level of detail: a range of the shared index buffer */
+struct MeshLod {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error; // estimated deviation from level 0, in model units
+};
+
+/**
+* Quadric error edge collapse (Garland & Heckbert 1997). Vertices are only
+* removed, never moved or created, so the result indexes the same vertex
+* arrays and every kept vertex keeps its normal and UV. Vertices split on a
+* UV/normal seam (same position, different attributes) are never removed;
+* open borders only collapse along the border. `normals` may be empty; if
+* given, collapses between vertices whose normals differ by more than ~45
+* degrees are rejected. Simplification stops at `targetIndexCount` or when
+* the next collapse would exceed `targetError`. The reached error is written
+* to `resultError`.
+*/
+std::vector<unsigned int> simplifyMesh(
+    const std::vector<unsigned int>& indices,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec3>& normals,
+    size_t targetIndexCount,
+    float targetError,
+    float* resultError = nullptr
+);
+
+/**
+* Appends coarser levels to `indices`, each with about half the triangles of
+* the previous one, until a level would have fewer than `minTriangles` or the
+* error gets above `maxError` (relative to the bounding box diagonal). The
+* returned lods[0] is the original index range.
+*/
+std::vector<MeshLod> buildLodChain(
+    std::vector<unsigned int>& indices,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec3>& normals,
+    size_t maxLevels = 6,
+    size_t minTriangles = 256,
+    float maxError = 0.05f
+);
+
+#endif
@@ -1,17 +1,24 @@
 ﻿#include <iostream>
-#include <sstream>
-#include <map>
-#include <tinyxml2.h>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include <cstring>
+#include <set>
+#include <algorithm>
+#include "obj_parser.h"
+#include "vtp_parser.h"
+#include "mesh_cache.h"
+#include "mesh_indexer.h"
+#include "parallel.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "geometry_pool.h"
 #include "util.h"
 #include "model.h"
+#include "gl_state.h"
 #include "texture.h"
+#include "asset_loader.h"
 
 using namespace glm;
 using namespace std;
 using namespace ogl;
-using namespace tinyxml2;
 
 // simple OBJ loader
 void loadOBJ(
@@ -112,116 +119,15 @@ void loadVTP(
     vector<vec3>& normals,
     vector<unsigned int>& indices) {
     indices.clear();
-    const char* method = "PolygonalMesh::loadVtpFile()";
-    XMLDocument vtp;
-    auto res = vtp.LoadFile(path.c_str());
-    assert(res == 0);
-
-    XMLElement* root = vtp.FirstChildElement("VTKFile");
-    assert(root != nullptr);
-    assert(root->Attribute("type", "PolyData"));
-
-    XMLElement* polydata = root->FirstChildElement("PolyData");
-    assert(polydata != nullptr);
-    XMLElement* piece = polydata->FirstChildElement("Piece");
-    assert(piece != nullptr);
-    XMLElement* enormals = piece->FirstChildElement("PointData");
-    assert(enormals != nullptr);
-    XMLElement* points = piece->FirstChildElement("Points");
-    assert(points != nullptr);
-
-    int numPoints, numPolys;
-    piece->QueryIntAttribute("NumberOfPoints", &numPoints);
-    piece->QueryIntAttribute("NumberOfPolys", &numPolys);
-
-    //assert(enormals->Attribute("format", "ascii"));
-    const char* normalsStr = enormals->FirstChildElement("DataArray")->FirstChild()->Value();
-    stringstream sNorm(normalsStr);
-    vector<vec3> tempNormals;
-    do {
-        vec3 normal;
-        sNorm >> normal.x >> normal.y >> normal.z;
-        tempNormals.push_back(normal);
-    } while (sNorm.good());
-    assert(tempNormals.size() == numPoints + 1);
-
-    XMLElement* pointData = points->FirstChildElement("DataArray");
-    assert(pointData != nullptr);
-    assert(pointData->Attribute("format", "ascii"));
-    const char* coordsStr = points->FirstChildElement("DataArray")->FirstChild()->Value();
-
-    stringstream sCoord(coordsStr);
-    vector<vec3> coordinates;
-    do {
-        vec3 coord;
-        sCoord >> coord.x >> coord.y >> coord.z;
-        coordinates.push_back(coord);
-    } while (sCoord.good());
-    coordinates.pop_back();  // the last is corrupted
-    assert(coordinates.size() == numPoints);
-
-    XMLElement* polys = piece->FirstChildElement("Polys");
-    assert(polys != nullptr);
-
-    // TODO beter implementation
-    XMLElement *econnectivity, *eoffsets;
-    if (polys->FirstChildElement("DataArray")->Attribute("Name", "connectivity")) {
-        econnectivity = polys->FirstChildElement("DataArray");
-        assert(econnectivity != nullptr);
-        assert(econnectivity->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access connectivity");
-    }
-
-    if (polys->LastChildElement("DataArray")->Attribute("Name", "offsets")) {
-        eoffsets = polys->LastChildElement("DataArray");
-        assert(eoffsets != nullptr);
-        assert(eoffsets->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access offsets");
-    }
-
-    // read offsets
-    const char* offsetsStr = eoffsets->FirstChild()->Value();
-    stringstream sOffsets(offsetsStr);
-    vector<int> offsets;
-    do {
-        int offset;
-        sOffsets >> offset;
-        offsets.push_back(offset);
-    } while (sOffsets.good());
-    assert(offsets.size() == numPolys + 1);
-
-    // read connectivity
-    const char* connStr = econnectivity->FirstChild()->Value();
-    stringstream sConn(connStr);
-    vector<int> connectivity;
-    do {
-        int conn;
-        sConn >> conn;
-        connectivity.push_back(conn);
-    } while (sConn.good());
-    assert(connectivity.size() == offsets.back() + 1);
-
-    // construct vertices
-    int startPoly = 0;
-    for (int i = 0; i < numPolys; ++i) {
-        vector<int> face = slice(connectivity, startPoly, offsets[i]);
-        int i1 = 0, i2 = 1, i3 = 2;
-        while (i3 != face.size()) {
-            vertices.push_back(coordinates[face[i1]]);
-            normals.push_back(tempNormals[face[i1]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i2]]);
-            normals.push_back(tempNormals[face[i2]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i3]]);
-            normals.push_back(tempNormals[face[i3]]);
-            indices.push_back(indices.size());
-            i2++;
-            i3++;
-        }
-        startPoly = offsets[i];
+    vector<vec3> points, pointNormals;
+    vector<unsigned int> triangles;
+    loadVTPIndexed(path, points, pointNormals, triangles);
+
+    // expand the triangles, one vertex per corner
+    for (unsigned int i : triangles) {
+        vertices.push_back(points[i]);
+        if (!pointNormals.empty()) normals.push_back(pointNormals[i]);
+        indices.push_back(indices.size());
     }
 }
 
@@ -236,7 +142,7 @@ void loadOBJWithTiny(
     vector<tinyobj::material_t> materials;
 
     string err;
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str())) {
+    if (!loadOBJMapped(&attrib, &shapes, &materials, &err, path.c_str())) {
         throw runtime_error(err);
     }
 
@@ -286,26 +192,112 @@ void loadOBJWithTiny(
     // TODO .mtl loader
 }
 
-struct PackedVertex {
-    glm::vec3 position;
-    glm::vec2 uv;
-    glm::vec3 normal;
-    bool operator<(const PackedVertex that) const {
-        return memcmp((void*) this, (void*) &that, sizeof(PackedVertex)) > 0;
-    };
-};
-
-bool getSimilarVertexIndex(
-    PackedVertex& packed,
-    map<PackedVertex, unsigned int>& vertexToOutIndex,
-    unsigned int& result) {
-    map<PackedVertex, unsigned int>::iterator it = vertexToOutIndex.find(packed);
-    if (it == vertexToOutIndex.end()) {
-        return false;
-    } else {
-        result = it->second;
-        return true;
+static_assert(sizeof(tinyobj::index_t) == 3 * sizeof(int),
+              "indexTriples() reads tinyobj::index_t as (vertex, normal, texcoord)");
+
+// Builds the indexed arrays of the corners, deduplicating them on their
+// (vertex, normal, texcoord) index triple with indexTriples(). Missing or
+// invalid normals become (0, 1, 0) and missing uvs (0, 0).
+static void indexCorners(
+    const tinyobj::attrib_t& attrib,
+    const vector<tinyobj::index_t>& corners,
+    bool withNormals,
+    vector<vec3>& out_vertices,
+    vector<vec2>& out_uvs,
+    vector<vec3>& out_normals,
+    vector<unsigned int>& out_indices) {
+    if (corners.empty()) return;
+    int numVertices = static_cast<int>(attrib.vertices.size() / 3);
+    int numNormals = static_cast<int>(attrib.normals.size() / 3);
+    int numTexcoords = static_cast<int>(attrib.texcoords.size() / 2);
+    bool withUVs = numTexcoords != 0;
+    size_t count = corners.size();
+    size_t chunks = count >= getParallelIndexingThreshold() ? workerCount() : 1;
+    auto chunkBegin = [&](size_t c, size_t n) { return n * c / chunks; };
+
+    // invalid normal and texcoord indices are keyed as -1, copied only if any
+    vector<char> invalid(chunks, 0);
+    parallelFor(chunks, [&](size_t c) {
+        for (size_t i = chunkBegin(c, count); i < chunkBegin(c + 1, count); i++) {
+            const tinyobj::index_t& index = corners[i];
+            if (index.vertex_index < 0 || index.vertex_index >= numVertices) {
+                throw runtime_error("Vertex index out of range");
+            }
+            if (index.normal_index < -1 || index.normal_index >= numNormals ||
+                index.texcoord_index < -1 || index.texcoord_index >= numTexcoords) {
+                invalid[c] = 1;
+            }
+        }
+    });
+    const tinyobj::index_t* keys = corners.data();
+    vector<tinyobj::index_t> valid;
+    if (find(invalid.begin(), invalid.end(), 1) != invalid.end()) {
+        valid = corners;
+        for (auto& index : valid) {
+            if (index.normal_index < 0 || index.normal_index >= numNormals) index.normal_index = -1;
+            if (index.texcoord_index < 0 || index.texcoord_index >= numTexcoords) index.texcoord_index = -1;
+        }
+        keys = valid.data();
+    }
+
+    vector<unsigned int> firsts;
+    indexTriples(&keys[0].vertex_index, count, out_indices, firsts);
+    vector<tinyobj::index_t>().swap(valid);
+
+    size_t unique = firsts.size();
+    out_vertices.resize(unique);
+    if (withUVs) out_uvs.resize(unique);
+    if (withNormals) out_normals.resize(unique);
+    parallelFor(chunks, [&](size_t c) {
+        for (size_t k = chunkBegin(c, unique); k < chunkBegin(c + 1, unique); k++) {
+            const tinyobj::index_t& index = corners[firsts[k]];
+            int v = index.vertex_index;
+            int n = index.normal_index >= 0 && index.normal_index < numNormals ? index.normal_index : -1;
+            int t = index.texcoord_index >= 0 && index.texcoord_index < numTexcoords ? index.texcoord_index : -1;
+            out_vertices[k] = vec3(
+                attrib.vertices[3 * v + 0],
+                attrib.vertices[3 * v + 1],
+                attrib.vertices[3 * v + 2]);
+            if (withUVs) {
+                out_uvs[k] = t < 0 ? vec2(0.0f) : vec2(
+                    attrib.texcoords[2 * t + 0],
+                    1 - attrib.texcoords[2 * t + 1]);
+            }
+            if (withNormals) {
+                out_normals[k] = n < 0 ? vec3(0.0f, 1.0f, 0.0f) : vec3(
+                    attrib.normals[3 * n + 0],
+                    attrib.normals[3 * n + 1],
+                    attrib.normals[3 * n + 2]);
+            }
+        }
+    });
+}
+
+void loadOBJIndexed(
+    const string& path,
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals,
+    vector<unsigned int>& indices) {
+    tinyobj::attrib_t attrib;
+    vector<tinyobj::shape_t> shapes;
+    vector<tinyobj::material_t> materials;
+
+    string err;
+    if (!loadOBJMapped(&attrib, &shapes, &materials, &err, path.c_str())) {
+        throw runtime_error(err);
     }
+
+    // one shape (the usual case for scans) is indexed in place
+    if (shapes.size() == 1) {
+        indexCorners(attrib, shapes[0].mesh.indices, true, vertices, uvs, normals, indices);
+        return;
+    }
+    vector<tinyobj::index_t> corners;
+    for (const auto& shape : shapes) {
+        corners.insert(corners.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+    }
+    indexCorners(attrib, corners, true, vertices, uvs, normals, indices);
 }
 
 void indexVBO(
@@ -316,104 +308,369 @@ void indexVBO(
     vector<vec3>& out_vertices,
     vector<vec2>& out_uvs,
     vector<vec3>& out_normals) {
-    map<PackedVertex, unsigned int> vertexToOutIndex;
-
-    // For each input vertex
-    for (int i = 0; i < static_cast<int>(in_vertices.size()); i++) {
-        vec3 vertices = in_vertices[i];
-        vec2 uvs;
-        vec3 normals;
-        if (in_uvs.size() != 0) uvs = in_uvs[i];
-        if (in_normals.size() != 0) normals = in_normals[i];
-        PackedVertex packed = {vertices, uvs, normals};
-
-        // Try to find a similar vertex in out_XXXX
-        unsigned int index;
-        bool found = getSimilarVertexIndex(packed, vertexToOutIndex, index);
-
-        if (found) { // A similar vertex is already in the VBO, use it instead !
-            out_indices.push_back(index);
-        } else { // If not, it needs to be added in the output data.
-            out_vertices.push_back(vertices);
-            if (in_uvs.size() != 0) out_uvs.push_back(uvs);
-            if (in_normals.size() != 0) out_normals.push_back(normals);
-            unsigned int newindex = (unsigned int) out_vertices.size() - 1;
-            out_indices.push_back(newindex);
-            vertexToOutIndex[packed] = newindex;
-        }
+    indexVertices(
+        in_vertices.data(),
+        in_uvs.size() != 0 ? in_uvs.data() : nullptr,
+        in_normals.size() != 0 ? in_normals.data() : nullptr,
+        in_vertices.size(),
+        out_indices, out_vertices, out_uvs, out_normals);
+}
+
+static void computeBounds(const vector<vec3>& vertices, vec3& boundsMin, vec3& boundsMax) {
+    boundsMin = boundsMax = vertices.empty() ? vec3(0.0f) : vertices[0];
+    for (const auto& v : vertices) {
+        boundsMin = glm::min(boundsMin, v);
+        boundsMax = glm::max(boundsMax, v);
     }
 }
 
-Drawable::Drawable(string path) {
+MeshData loadMeshData(const string& path) {
+    MeshData data;
+    data.path = path;
+
+    // a cache built from the same file skips parsing and indexing entirely
+    unique_ptr<MeshCache> cache(new MeshCache());
+    if (cache->open(path)) {
+        cout << "Loading mesh cache: " << path << endl;
+        data.lods.assign(cache->lods(), cache->lods() + cache->lodCount());
+        data.boundsMin = cache->boundsMin();
+        data.boundsMax = cache->boundsMax();
+        data.cache = std::move(cache);
+        return data;
+    }
+
     if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
+        loadOBJIndexed(path, data.vertices, data.uvs, data.normals, data.indices);
     } else if (path.substr(path.size() - 3, 3) == "vtp") {
-        loadVTP(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
+        loadVTPIndexed(path, data.vertices, data.normals, data.indices);
     } else {
         throw runtime_error("File format not supported: " + path);
     }
+    // optimized once here, the cache stores the reordered mesh
+    optimizeMesh(path, data.vertices, data.normals, data.uvs, data.indices);
+    computeBounds(data.vertices, data.boundsMin, data.boundsMax);
+    data.lods = buildLodChain(data.indices, data.vertices, data.normals);
+    if (data.lods.size() > 1) {
+        cout << "Built " << data.lods.size() - 1 << " LODs for " << path << ":";
+        for (const MeshLod& lod : data.lods) cout << " " << lod.indexCount / 3;
+        cout << " triangles" << endl;
+    }
 
-    createContext();
+    MeshCache::save(path, data.vertices, data.uvs, data.normals, data.indices, data.lods,
+                    data.boundsMin, data.boundsMax);
+    return data;
+}
+
+static Retention defaultRetention = Retention::KeepAll;
+
+void setDefaultRetention(Retention retention) {
+    defaultRetention = retention;
+}
+
+Retention getDefaultRetention() {
+    return defaultRetention;
+}
+
+template<typename T>
+static size_t heapBytes(const vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+template<typename T>
+static void release(vector<T>& v) {
+    vector<T>().swap(v);
+}
+
+static VertexLayout defaultVertexLayout = VertexLayout::Separate;
+
+void setDefaultVertexLayout(VertexLayout layout) {
+    defaultVertexLayout = layout;
+}
+
+VertexLayout getDefaultVertexLayout() {
+    return defaultVertexLayout;
+}
+
+// Creates the VAO and buffers of an indexed mesh in the given layout
+static void uploadGeometry(
+    VertexLayout layout,
+    const vec3* vertices, const vec3* normals, const vec2* uvs, size_t vertexCount,
+    const unsigned int* indices, size_t indexCount,
+    GLuint& VAO, GLuint& verticesVBO, GLuint& normalsVBO, GLuint& uvsVBO,
+    GLuint& elementVBO, GLenum& indexType, mat4& dequantization,
+    GeometryPool*& pool, GeometryRange& range) {
+    VAO = verticesVBO = normalsVBO = uvsVBO = elementVBO = 0;
+    dequantization = mat4();
+    pool = nullptr;
+    range = GeometryRange{0, 0, 0, 0};
+
+    // indices are relative to the first vertex, so pooled meshes get 16 bits too
+    vector<unsigned short> shortIndices;
+    const void* indexData = indices;
+    size_t indexBytes = indexCount * sizeof(unsigned int);
+    indexType = GL_UNSIGNED_INT;
+    if (vertexCount <= 65536) {
+        shortIndices.assign(indices, indices + indexCount);
+        indexData = shortIndices.data();
+        indexBytes = indexCount * sizeof(unsigned short);
+        indexType = GL_UNSIGNED_SHORT;
+    }
+
+    if (layout != VertexLayout::Separate && getGeometryPooling()) {
+        vector<unsigned char> data =
+            encodeVertices(layout, vertices, normals, uvs, vertexCount, dequantization);
+        pool = &GeometryPool::get(layout, normals != nullptr, uvs != nullptr);
+        range = pool->allocate(data.data(), vertexCount, indexData, indexBytes);
+        VAO = pool->vao();
+        return;
+    }
+
+    glGenVertexArrays(1, &VAO);
+    GLState::bindVertexArray(VAO);
+
+    glGenBuffers(1, &verticesVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
+
+    if (layout == VertexLayout::Separate) {
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(vec3), vertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(0);
+
+        if (normals) {
+            glGenBuffers(1, &normalsVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(vec3), normals, GL_STATIC_DRAW);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+            glEnableVertexAttribArray(1);
+        }
+
+        if (uvs) {
+            glGenBuffers(1, &uvsVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(vec2), uvs, GL_STATIC_DRAW);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+            glEnableVertexAttribArray(2);
+        }
+    } else {
+        vector<unsigned char> data =
+            encodeVertices(layout, vertices, normals, uvs, vertexCount, dequantization);
+        glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+        setVertexAttributes(layout, normals != nullptr, uvs != nullptr);
+    }
+
+    // Generate a buffer for the indices as well
+    glGenBuffers(1, &elementVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
+}
+
+// draws `count` indices from `first` on, of a pooled or standalone mesh
+static void drawRange(int mode, size_t first, size_t count, GLenum indexType,
+                      const GeometryRange& range, size_t instances = 1) {
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    void* offset = reinterpret_cast<void*>(range.indexOffset + first * indexSize);
+    if (instances == 1) {
+        glDrawElementsBaseVertex(mode, static_cast<GLsizei>(count), indexType, offset,
+                                 static_cast<GLint>(range.baseVertex));
+    } else {
+        glDrawElementsInstancedBaseVertex(mode, static_cast<GLsizei>(count), indexType, offset,
+                                          static_cast<GLsizei>(instances),
+                                          static_cast<GLint>(range.baseVertex));
+    }
+}
+
+// attribute locations of Drawable::drawInstanced()
+static const GLuint INSTANCE_MATRIX_LOCATION = 3; // 4 locations, one per column
+static const GLuint INSTANCE_MATERIAL_LOCATION = 7;
+
+// live Drawables, for printMemoryReport()
+static set<const Drawable*> drawables;
+
+Drawable::Drawable(string path, Retention retention, VertexLayout layout)
+    : Drawable(loadMeshData(path), retention, layout) {}
+
+Drawable::Drawable(MeshData&& data, Retention retention, VertexLayout layout)
+    : name(std::move(data.path)), retention(retention),
+    indexedVertices(std::move(data.vertices)), indexedNormals(std::move(data.normals)),
+    indexedUVS(std::move(data.uvs)), indices(std::move(data.indices)),
+    lods(std::move(data.lods)), layout(layout), instanceVBO(0),
+    boundsMin(data.boundsMin), boundsMax(data.boundsMax) {
+    if (data.cache) {
+        // straight from the mapping, which is closed once uploaded
+        const MeshCache& cache = *data.cache;
+        size_t n = cache.vertexCount();
+        indexCount = cache.indexCount();
+        uploadContext(cache.vertices(), cache.normals(), cache.uvs(), n,
+                      cache.indices(), indexCount);
+        if (retention != Retention::KeepNone) {
+            indexedVertices.assign(cache.vertices(), cache.vertices() + n);
+            if (cache.normals()) indexedNormals.assign(cache.normals(), cache.normals() + n);
+            if (cache.uvs()) indexedUVS.assign(cache.uvs(), cache.uvs() + n);
+            indices.assign(cache.indices(), cache.indices() + indexCount);
+        }
+        data.cache.reset();
+    } else {
+        indexCount = indices.size();
+        uploadContext(
+            indexedVertices.data(),
+            indexedNormals.empty() ? nullptr : indexedNormals.data(),
+            indexedUVS.empty() ? nullptr : indexedUVS.data(),
+            indexedVertices.size(), indices.data(), indices.size());
+    }
+    applyRetention();
+    drawables.insert(this);
 }
 
 Drawable::Drawable(const vector<vec3>& vertices, const vector<vec2>& uvs,
-                   const vector<vec3>& normals) : vertices(vertices), uvs(uvs), normals(normals) {
+                   const vector<vec3>& normals, Retention retention, VertexLayout layout)
+    : retention(retention), vertices(vertices), normals(normals), uvs(uvs), layout(layout),
+    instanceVBO(0) {
     createContext();
+    applyRetention();
+    drawables.insert(this);
 }
 
 Drawable::~Drawable() {
+    drawables.erase(this);
+    glDeleteBuffers(1, &instanceVBO);
+    if (pool) {
+        pool->release(range);
+        return;
+    }
     glDeleteBuffers(1, &verticesVBO);
     glDeleteBuffers(1, &uvsVBO);
     glDeleteBuffers(1, &normalsVBO);
     glDeleteBuffers(1, &elementVBO);
-    glDeleteBuffers(1, &VAO);
+    GLState::deleteVertexArrays(1, &VAO);
+}
+
+size_t Drawable::memoryUsage() const {
+    return heapBytes(vertices) + heapBytes(normals) + heapBytes(uvs) +
+        heapBytes(indexedVertices) + heapBytes(indexedNormals) + heapBytes(indexedUVS) +
+        heapBytes(indices);
+}
+
+void Drawable::printMemoryReport() {
+    size_t total = 0;
+    cout << "Drawable memory report:" << endl;
+    for (const Drawable* d : drawables) {
+        size_t bytes = d->memoryUsage();
+        total += bytes;
+        cout << "  " << (d->name.empty() ? "<arrays>" : d->name) << ": " << bytes
+            << " bytes, " << d->indexCount << " indices" << endl;
+    }
+    cout << "  total: " << total << " bytes in " << drawables.size() << " drawables" << endl;
+}
+
+void Drawable::applyRetention() {
+    if (retention == Retention::KeepAll) return;
+    release(vertices);
+    release(normals);
+    release(uvs);
+    if (retention == Retention::KeepIndexed) return;
+    release(indexedVertices);
+    release(indexedNormals);
+    release(indexedUVS);
+    release(indices);
 }
 
 void Drawable::bind() {
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 }
 
 void Drawable::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+    drawLod(0, mode);
 }
 
-void Drawable::createContext() {
-    indices = vector<unsigned int>();
-    indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+void Drawable::drawLod(size_t level, int mode) {
+    const MeshLod& lod = lods[std::min(level, lods.size() - 1)];
+    drawRange(mode, lod.indexOffset, lod.indexCount, indexType, range);
+}
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+void Drawable::drawInstanced(const mat4* models, const GLuint* materials, size_t count,
+                             size_t level, int mode) {
+    if (!count) return;
+    if (!instanceVBO) glGenBuffers(1, &instanceVBO);
+
+    // orphan the old contents, so the upload never waits for the last draw
+    size_t matrixBytes = count * sizeof(mat4);
+    size_t materialBytes = materials ? count * sizeof(GLuint) : 0;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, matrixBytes + materialBytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, matrixBytes, models);
+    if (materials) glBufferSubData(GL_ARRAY_BUFFER, matrixBytes, materialBytes, materials);
+
+    // pooled Drawables share the VAO, so the instance attributes only stay
+    // enabled for this draw
+    for (GLuint i = 0; i < 4; i++) {
+        glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + i, 4, GL_FLOAT, GL_FALSE,
+                              sizeof(mat4), reinterpret_cast<void*>(i * sizeof(vec4)));
+        glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + i, 1);
+        glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + i);
+    }
+    if (materials) {
+        glVertexAttribIPointer(INSTANCE_MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, 0,
+                               reinterpret_cast<void*>(matrixBytes));
+        glVertexAttribDivisor(INSTANCE_MATERIAL_LOCATION, 1);
+        glEnableVertexAttribArray(INSTANCE_MATERIAL_LOCATION);
+    } else {
+        glVertexAttribI4ui(INSTANCE_MATERIAL_LOCATION, 0, 0, 0, 0);
+    }
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+    const MeshLod& lod = lods[std::min(level, lods.size() - 1)];
+    drawRange(mode, lod.indexOffset, lod.indexCount, indexType, range, count);
+
+    for (GLuint i = 0; i < 4; i++) glDisableVertexAttribArray(INSTANCE_MATRIX_LOCATION + i);
+    glDisableVertexAttribArray(INSTANCE_MATERIAL_LOCATION);
+}
 
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
+size_t Drawable::selectLod(const mat4& model, const mat4& view, const mat4& projection,
+                           float viewportHeight, float pixelError) const {
+    if (lods.size() < 2) return 0;
+
+    // bounding sphere of the mesh in view space
+    float scale = std::max(length(vec3(model[0])),
+                           std::max(length(vec3(model[1])), length(vec3(model[2]))));
+    float radius = 0.5f * length(boundsMax - boundsMin) * scale;
+    vec3 center = vec3(view * model * vec4(0.5f * (boundsMin + boundsMax), 1.0f));
+
+    // model units to pixels, at the nearest point of the sphere for perspective
+    float pixelsPerUnit = 0.5f * viewportHeight * projection[1][1] * scale;
+    if (projection[3][3] == 0.0f) {
+        float distance = length(center) - radius;
+        if (distance <= 0.0f) return 0;
+        pixelsPerUnit /= distance;
     }
 
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
+    size_t level = 0;
+    while (level + 1 < lods.size() && lods[level + 1].error * pixelsPerUnit <= pixelError) {
+        level++;
     }
+    return level;
+}
 
-    // Generate a buffer for the indices as well
-    glGenBuffers(1, &elementVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+void Drawable::createContext() {
+    indices = vector<unsigned int>();
+    indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+    optimizeMesh(name.empty() ? "drawable" : name,
+                 indexedVertices, indexedNormals, indexedUVS, indices);
+    computeBounds(indexedVertices, boundsMin, boundsMax);
+    indexCount = indices.size();
+
+    uploadContext(
+        indexedVertices.data(),
+        indexedNormals.empty() ? nullptr : indexedNormals.data(),
+        indexedUVS.empty() ? nullptr : indexedUVS.data(),
+        indexedVertices.size(), indices.data(), indices.size());
+}
+
+void Drawable::uploadContext(
+    const vec3* vertices, const vec3* normals, const vec2* uvs, size_t vertexCount,
+    const unsigned int* indices, size_t indexCount) {
+    uploadGeometry(layout, vertices, normals, uvs, vertexCount, indices, indexCount,
+                   VAO, verticesVBO, normalsVBO, uvsVBO, elementVBO, indexType,
+                   dequantization, pool, range);
+    if (lods.empty()) lods.push_back({0, static_cast<uint32_t>(indexCount), 0.0f});
 }
 
 /*****************************************************************************/
@@ -422,18 +679,40 @@ Mesh::Mesh(
     const vector<vec3>& vertices,
     const vector<vec2>& uvs,
     const vector<vec3>& normals,
-    const Material& mtl)
-    : vertices{vertices}, uvs{uvs}, normals{normals}, mtl{mtl} {
+    const Material& mtl,
+    Retention retention,
+    VertexLayout layout)
+    : vertices{vertices}, normals{normals}, uvs{uvs}, mtl{mtl}, retention{retention},
+    layout{layout} {
     createContext();
+    applyRetention();
+}
+
+Mesh::Mesh(
+    vector<vec3>&& indexedVertices,
+    vector<vec2>&& indexedUVS,
+    vector<vec3>&& indexedNormals,
+    vector<unsigned int>&& indices,
+    const Material& mtl,
+    Retention retention,
+    VertexLayout layout)
+    : indexedVertices{std::move(indexedVertices)}, indexedNormals{std::move(indexedNormals)},
+    indexedUVS{std::move(indexedUVS)}, indices{std::move(indices)}, mtl{mtl},
+    retention{retention}, layout{layout} {
+    uploadContext();
+    applyRetention();
 }
 
 Mesh::Mesh(Mesh&& other)
     : vertices{std::move(other.vertices)}, normals{std::move(other.normals)},
     indexedVertices{std::move(other.indexedVertices)}, indexedNormals{std::move(other.indexedNormals)},
     uvs{std::move(other.uvs)}, indexedUVS{std::move(other.indexedUVS)},
-    indices{std::move(other.indices)}, mtl{std::move(other.mtl)},
+    indices{std::move(other.indices)}, indexCount{other.indexCount},
+    mtl{std::move(other.mtl)}, retention{other.retention}, layout{other.layout},
     VAO{other.VAO}, verticesVBO{other.verticesVBO}, normalsVBO{other.normalsVBO},
-    uvsVBO{other.uvsVBO}, elementVBO{other.elementVBO} {
+    uvsVBO{other.uvsVBO}, elementVBO{other.elementVBO}, indexType{other.indexType},
+    pool{other.pool}, range(other.range), dequantization{other.dequantization} {
+    other.pool = nullptr;
     other.VAO = 0;
     other.verticesVBO = 0;
     other.normalsVBO = 0;
@@ -442,62 +721,74 @@ Mesh::Mesh(Mesh&& other)
 }
 
 Mesh::~Mesh() {
+    if (pool) {
+        pool->release(range);
+        return;
+    }
     glDeleteBuffers(1, &verticesVBO);
     glDeleteBuffers(1, &uvsVBO);
     glDeleteBuffers(1, &normalsVBO);
     glDeleteBuffers(1, &elementVBO);
-    glDeleteVertexArrays(1, &VAO);
+    GLState::deleteVertexArrays(1, &VAO);
 }
 
 void Mesh::bind() {
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 }
 
 void Mesh::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+    drawRange(mode, 0, indexCount, indexType, range);
+}
+
+size_t Mesh::memoryUsage() const {
+    return heapBytes(vertices) + heapBytes(normals) + heapBytes(uvs) +
+        heapBytes(indexedVertices) + heapBytes(indexedNormals) + heapBytes(indexedUVS) +
+        heapBytes(indices);
+}
+
+void Mesh::applyRetention() {
+    if (retention == Retention::KeepAll) return;
+    release(vertices);
+    release(normals);
+    release(uvs);
+    if (retention == Retention::KeepIndexed) return;
+    release(indexedVertices);
+    release(indexedNormals);
+    release(indexedUVS);
+    release(indices);
 }
 
 void Mesh::createContext() {
     indices = vector<unsigned int>();
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+    optimizeMesh("mesh", indexedVertices, indexedNormals, indexedUVS, indices);
+    uploadContext();
+}
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
-    }
+void Mesh::uploadContext() {
+    indexCount = indices.size();
+    uploadGeometry(
+        layout,
+        indexedVertices.data(),
+        indexedNormals.empty() ? nullptr : indexedNormals.data(),
+        indexedUVS.empty() ? nullptr : indexedUVS.data(),
+        indexedVertices.size(), indices.data(), indices.size(),
+        VAO, verticesVBO, normalsVBO, uvsVBO, elementVBO, indexType, dequantization,
+        pool, range);
+}
 
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
+bool MaterialLess::operator()(const Material& a, const Material& b) const {
+    // texture changes cost the most, so the texture set is the major key
+    GLuint ta[4] = {a.texKa, a.texKd, a.texKs, a.texNs};
+    GLuint tb[4] = {b.texKa, b.texKd, b.texKs, b.texNs};
+    for (int i = 0; i < 4; i++) {
+        if (ta[i] != tb[i]) return ta[i] < tb[i];
     }
-
-    // Generate a buffer for the indices as well
-    glGenBuffers(1, &elementVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+    return memcmp(&a, &b, sizeof(Material)) < 0;
 }
 
 Model::Model(string path, Model::MTLUploadFunction* uploader)
-    : uploadFunction{uploader} {
+    : uploadFunction{uploader}, stats() {
     if (path.substr(path.size() - 3, 3) == "obj") {
         loadOBJWithTiny(path.c_str());
     } else {
@@ -507,16 +798,27 @@ Model::Model(string path, Model::MTLUploadFunction* uploader)
 
 Model::~Model() {
     for (const auto& t : textures) {
-        glDeleteTextures(1, &t.second);
+        GLState::deleteTextures(1, &t.second);
     }
 }
 
 void Model::draw() {
+    stats = DrawStats();
+    // pooled meshes share the pool's VAO, GLState drops the repeated binds
+    GLuint boundVAO = 0;
     for (auto& mesh : meshes) {
         mesh.bind();
-        if (uploadFunction)
+        if (mesh.VAO != boundVAO) {
+            boundVAO = mesh.VAO;
+            stats.vaoBinds++;
+        }
+        // meshes are merged by material, so every one needs its own upload
+        if (uploadFunction) {
             uploadFunction(mesh.mtl);
+            stats.materialUploads++;
+        }
         mesh.draw();
+        stats.draws++;
     }
 }
 
@@ -526,77 +828,79 @@ void Model::loadOBJWithTiny(const std::string& filename) {
     vector<tinyobj::material_t> materials;
 
     string err;
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str())) {
+    if (!loadOBJMapped(&attrib, &shapes, &materials, &err, filename.c_str())) {
         throw runtime_error(err);
     }
 
+    // decode the textures on the worker threads
+    AssetLoader loader;
     for (const auto& material : materials) {
-        loadTexture(material.ambient_texname);
-        loadTexture(material.diffuse_texname);
-        loadTexture(material.specular_texname);
-        loadTexture(material.specular_highlight_texname);
+        loadTexture(material.ambient_texname, loader);
+        loadTexture(material.diffuse_texname, loader);
+        loadTexture(material.specular_texname, loader);
+        loadTexture(material.specular_highlight_texname, loader);
+    }
+
+    loader.finish();
+    for (const auto& texture : textures) {
+        if (!texture.second) throw std::runtime_error("Failed to load texture: " + texture.first);
+    }
+
+    vector<Material> mtls(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        const tinyobj::material_t& mat = materials[i];
+        Material& mtl = mtls[i];
+        mtl = {
+            {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1},
+            {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1},
+            {mat.specular[0], mat.specular[1], mat.specular[2], 1},
+            mat.shininess,
+            textures[mat.ambient_texname],
+            textures[mat.diffuse_texname],
+            textures[mat.specular_texname],
+            textures[mat.specular_highlight_texname]
+        };
+        if (mtl.texKa) mtl.Ka.r = -1.0f;
+        if (mtl.texKd) mtl.Kd.r = -1.0f;
+        if (mtl.texKs) mtl.Ks.r = -1.0f;
+        if (mtl.texNs) mtl.Ns = -1.0f;
     }
 
+    // faces of all shapes grouped by material, identical materials share a group
+    map<Material, vector<tinyobj::index_t>, MaterialLess> groups;
+    vector<vector<tinyobj::index_t>*> groupOf(materials.size() + 1, nullptr);
     for (const auto& shape : shapes) {
-        vector<vec3> vertices{};
-        vector<vec2> uvs{};
-        vector<vec3> normals{};
-        for (const auto& index : shape.mesh.indices) {
-            int vertex_index = index.vertex_index;
-            if (vertex_index < 0) vertex_index += attrib.vertices.size() / 3;
-            vec3 vertex = {
-                attrib.vertices[3 * vertex_index + 0],
-                attrib.vertices[3 * vertex_index + 1],
-                attrib.vertices[3 * vertex_index + 2]};
-            if (attrib.texcoords.size() != 0) {
-                int texcoord_index = index.texcoord_index;
-                if (texcoord_index < 0) texcoord_index += attrib.texcoords.size() / 2;
-                vec2 uv = {
-                    attrib.texcoords[2 * texcoord_index + 0],
-                    1 - attrib.texcoords[2 * texcoord_index + 1]};
-                uvs.push_back(uv);
-            }
-            if (attrib.normals.size() != 0) {
-                int normal_index = index.normal_index;
-                if (normal_index < 0) normal_index += attrib.normals.size() / 3;
-                vec3 normal = {
-                    attrib.normals[3 * normal_index + 0],
-                    attrib.normals[3 * normal_index + 1],
-                    attrib.normals[3 * normal_index + 2]};
-                normals.push_back(normal);
-            }
-            vertices.push_back(vertex);
-        }
-        Material mtl{};
-        if (materials.size() > 0 && shape.mesh.material_ids.size() > 0) {
-            int idx = shape.mesh.material_ids[0];
+        const vector<tinyobj::index_t>& corners = shape.mesh.indices;
+        for (size_t f = 0; 3 * f + 2 < corners.size(); f++) {
+            // faces without a (valid) material use the last one, as before
+            int idx = f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f] : -1;
             if (idx < 0 || idx >= static_cast<int>(materials.size()))
                 idx = static_cast<int>(materials.size()) - 1;
-            tinyobj::material_t mat = materials[idx];
-            mtl = {
-                {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1},
-                {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1},
-                {mat.specular[0], mat.specular[1], mat.specular[2], 1},
-                mat.shininess,
-                textures[mat.ambient_texname],
-                textures[mat.diffuse_texname],
-                textures[mat.specular_texname],
-                textures[mat.specular_highlight_texname]
-            };
-            if (mtl.texKa) mtl.Ka.r = -1.0f;
-            if (mtl.texKd) mtl.Kd.r = -1.0f;
-            if (mtl.texKs) mtl.Ks.r = -1.0f;
-            if (mtl.texNs) mtl.Ns = -1.0f;
+            vector<tinyobj::index_t>*& group = groupOf[idx + 1];
+            if (!group) group = &groups[idx < 0 ? Material{} : mtls[idx]];
+            group->insert(group->end(), corners.begin() + 3 * f, corners.begin() + 3 * f + 3);
         }
-        meshes.emplace_back(vertices, uvs, normals, mtl);
     }
+
+    // the map order is the draw order: by texture set, then by material
+    for (const auto& group : groups) {
+        vector<vec3> vertices{}, normals{};
+        vector<vec2> uvs{};
+        vector<unsigned int> indices{};
+        indexCorners(attrib, group.second, !attrib.normals.empty(),
+                     vertices, uvs, normals, indices);
+        optimizeMesh(filename + ":" + to_string(meshes.size()), vertices, normals, uvs, indices);
+        meshes.emplace_back(std::move(vertices), std::move(uvs), std::move(normals),
+                            std::move(indices), group.first);
+    }
+    cout << "Loaded " << filename << ": " << shapes.size() << " shapes, "
+        << meshes.size() << " draws" << endl;
 }
 
-void Model::loadTexture(const std::string& filename) {
+void Model::loadTexture(const std::string& filename, AssetLoader& loader) {
     if (filename.length() == 0) return;
     if (textures.find(filename) == end(textures)) {
-        GLuint id = loadSOIL(filename.c_str());
-        if (!id) throw std::runtime_error("Failed to load texture: " + filename);
-        textures[filename] = id;
+        textures[filename] = 0;
+        loader.soil(filename, &textures[filename]);
     }
-}
\ No newline at end of file
+}
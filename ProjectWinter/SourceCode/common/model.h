@@ -5,7 +5,10 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include <glm/glm.hpp>
+#include "mesh_simplifier.h"
+#include "mesh_cache.h"
 
 static std::vector<unsigned int> VEC_UINT_DEFAUTL_VALUE{};
 static std::vector<glm::vec3> VEC_VEC3_DEFAUTL_VALUE{};
@@ -24,7 +27,8 @@ void loadOBJ(
 );
 
 /**
-* A .vtp loader.
+* A .vtp loader, one vertex per triangle corner. Drawable uses the indexed
+* loadVTPIndexed() of vtp_parser.h instead.
 */
 void loadVTP(
     const std::string& path,
@@ -48,7 +52,20 @@ void loadOBJWithTiny(
 );
 
 /**
-* Create VBO indexing.
+* Loads an .obj file directly into indexed arrays, deduplicating the corners
+* on their (vertex, normal, texcoord) index triple. All shapes are merged.
+* Corners without a normal get (0, 1, 0).
+*/
+void loadOBJIndexed(
+    const std::string& path,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices
+);
+
+/**
+* Create VBO indexing (see indexVertices() in mesh_indexer.h).
 * http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-9-vbo-indexing/
 */
 void indexVBO(
@@ -61,35 +78,163 @@ void indexVBO(
     std::vector<glm::vec3> & out_normals
 );
 
+/**
+* What a Drawable or ogl::Mesh keeps in RAM after uploading to the GPU.
+*/
+enum class Retention {
+    KeepAll,     // vertices, uvs, normals, their indexed versions and indices
+    KeepIndexed, // indexedVertices, indexedUVS, indexedNormals and indices
+    KeepNone     // only the index count (and bounds for Drawable)
+};
+
+/* Policy of Drawables/Meshes constructed without one, KeepAll by default */
+void setDefaultRetention(Retention retention);
+Retention getDefaultRetention();
+
+/**
+* How a Drawable or ogl::Mesh stores its vertices on the GPU. The attribute
+* locations are always 0 = position, 1 = normal, 2 = uv. Indices are 16 bit
+* whenever there are at most 65536 vertices.
+*/
+enum class VertexLayout {
+    Separate,    // one float VBO per attribute, 32 bytes per vertex
+    Interleaved, // float position, normal and uv in one VBO, 32 bytes
+    Packed,      // float position, GL_INT_2_10_10_10_REV normal, half uv, 20 bytes
+    Quantized    // like Packed with 16 bit unorm positions inside the bounds,
+                 // 16 bytes; the vertex shader must apply `dequantization`
+};
+
+/* Layout of Drawables/Meshes constructed without one, Separate by default */
+void setDefaultVertexLayout(VertexLayout layout);
+VertexLayout getDefaultVertexLayout();
+
+class GeometryPool;
+
+/* Where a mesh lives in a GeometryPool, see geometry_pool.h */
+struct GeometryRange {
+    size_t baseVertex, vertexCount; // in vertices
+    size_t indexOffset, indexBytes; // in bytes
+};
+
+/**
+* The indexed CPU side of a Drawable, see loadMeshData().
+*/
+struct MeshData {
+    std::string path;
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<unsigned int> indices;
+    std::vector<MeshLod> lods; // ranges of `indices`, lods[0] is the full mesh
+    glm::vec3 boundsMin, boundsMax;
+    /* Set on a cache hit instead of the arrays above, which stay empty */
+    std::unique_ptr<MeshCache> cache;
+};
+
+/**
+* Loads an .obj/.vtp file, or its .meshcache if it is up to date (see
+* mesh_cache.h), and writes the cache on a miss. A miss also optimizes the
+* mesh and builds its LOD chain (see mesh_simplifier.h). Makes no GL calls, so
+* it can run on a worker thread.
+*/
+MeshData loadMeshData(const std::string& path);
+
 class Drawable {
 public:
-    Drawable(std::string path);
+    /* Same as Drawable(loadMeshData(path)) */
+    Drawable(std::string path, Retention retention = getDefaultRetention(),
+             VertexLayout layout = getDefaultVertexLayout());
+
+    /**
+    * Uploads indexed data, vertices, normals and uvs are left empty. A cached
+    * mesh is uploaded from the mapping and only copied if the retention keeps it.
+    */
+    Drawable(MeshData&& data, Retention retention = getDefaultRetention(),
+             VertexLayout layout = getDefaultVertexLayout());
 
     Drawable(
         const std::vector<glm::vec3>& vertices,
         const std::vector<glm::vec2>& uvs = VEC_VEC2_DEFAUTL_VALUE,
-        const std::vector<glm::vec3>& normals = VEC_VEC3_DEFAUTL_VALUE);
+        const std::vector<glm::vec3>& normals = VEC_VEC3_DEFAUTL_VALUE,
+        Retention retention = getDefaultRetention(),
+        VertexLayout layout = getDefaultVertexLayout());
 
     ~Drawable();
 
     void bind();
 
-    /* Bind VAO before calling draw */
+    /* Bind VAO before calling draw, draws the full detail level */
     void draw(int mode = GL_TRIANGLES);
+    void drawLod(size_t level, int mode = GL_TRIANGLES);
+
+    /**
+    * Draws `count` instances of a level in one call. The model matrices are
+    * streamed to attributes 3-6 and the material indices (may be nullptr,
+    * then all 0) to the uint attribute 7, both advancing per instance. Bind
+    * the VAO first.
+    */
+    void drawInstanced(const glm::mat4* models, const GLuint* materials, size_t count,
+                       size_t level = 0, int mode = GL_TRIANGLES);
+
+    /**
+    * Coarsest level whose error projects to at most `pixelError` pixels on a
+    * viewport `viewportHeight` pixels high. Works for perspective and
+    * orthographic projections; a camera inside the bounding sphere gets 0.
+    */
+    size_t selectLod(const glm::mat4& model, const glm::mat4& view,
+                     const glm::mat4& projection, float viewportHeight,
+                     float pixelError = 1.0f) const;
+
+    /* Bytes of geometry held in RAM */
+    size_t memoryUsage() const;
+
+    /* Prints memoryUsage() of every live Drawable and the total */
+    static void printMemoryReport();
 
 public:
+    std::string name; // source file, empty if built from arrays
+    Retention retention;
+
     std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
     std::vector<glm::vec2> uvs, indexedUVS;
     std::vector<unsigned int> indices;
 
+    /* Index ranges of the levels of detail, at least one */
+    std::vector<MeshLod> lods;
+
+    /* Number of indices uploaded to elementVBO (all levels), kept by all policies */
+    size_t indexCount;
+
+    VertexLayout layout;
+    /**
+    * uvsVBO and normalsVBO are 0 unless the layout is Separate. Pooled
+    * geometry (every other layout, see setGeometryPooling()) owns no GL
+    * objects: VAO is the pool's and `range` is the part of its buffers.
+    */
     GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+    GLenum indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GeometryPool* pool;
+    GeometryRange range;
+    /* Per instance data of drawInstanced(), created on first use */
+    GLuint instanceVBO;
+
+    /* Maps the stored positions to model space, identity unless Quantized */
+    glm::mat4 dequantization;
+
+    /* Axis aligned bounding box of the vertices */
+    glm::vec3 boundsMin, boundsMax;
 
 private:
     void createContext();
+    void applyRetention();
+    void uploadContext(
+        const glm::vec3* vertices, const glm::vec3* normals, const glm::vec2* uvs,
+        size_t vertexCount, const unsigned int* indices, size_t indexCount);
 };
 
 /*****************************************************************************/
 
+class AssetLoader;
+
 namespace ogl {
     struct Material {
         glm::vec4 Ka;
@@ -102,25 +247,51 @@ namespace ogl {
         GLuint texNs;
     };
 
+    /* Orders materials by texture set, then by the remaining values */
+    struct MaterialLess {
+        bool operator()(const Material& a, const Material& b) const;
+    };
+
     class Mesh {
     public:
         Mesh(const std::vector<glm::vec3>& vertices,
              const std::vector<glm::vec2>& uvs,
              const std::vector<glm::vec3>& normals,
-             const Material& mtl);
+             const Material& mtl,
+             Retention retention = getDefaultRetention(),
+             VertexLayout layout = getDefaultVertexLayout());
+        /* Takes already indexed data, vertices/uvs/normals are left empty */
+        Mesh(std::vector<glm::vec3>&& indexedVertices,
+             std::vector<glm::vec2>&& indexedUVS,
+             std::vector<glm::vec3>&& indexedNormals,
+             std::vector<unsigned int>&& indices,
+             const Material& mtl,
+             Retention retention = getDefaultRetention(),
+             VertexLayout layout = getDefaultVertexLayout());
         Mesh(const Mesh&) = delete;
         Mesh(Mesh&& other);
         ~Mesh();
         void bind();
         void draw(int mode = GL_TRIANGLES);
+        /* Bytes of geometry held in RAM */
+        size_t memoryUsage() const;
     public:
         std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
         std::vector<glm::vec2> uvs, indexedUVS;
         std::vector<unsigned int> indices;
+        size_t indexCount;
         Material mtl;
+        Retention retention;
+        VertexLayout layout;
         GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+        GLenum indexType;
+        GeometryPool* pool;
+        GeometryRange range;
+        glm::mat4 dequantization;
     private:
         void createContext();
+        void uploadContext();
+        void applyRetention();
     };
 
     class Model {
@@ -129,13 +300,21 @@ namespace ogl {
         Model(std::string path, MTLUploadFunction* uploader = nullptr);
         ~Model();
         void draw();
+
+        /* GL work done by the last draw() */
+        struct DrawStats {
+            size_t draws, vaoBinds, materialUploads;
+        };
+        const DrawStats& drawStats() const { return stats; }
     private:
+        /* One mesh per distinct material, sorted with MaterialLess */
         std::vector<Mesh> meshes;
         std::map<std::string, GLuint> textures;
         MTLUploadFunction* uploadFunction;
+        DrawStats stats;
     private:
         void loadOBJWithTiny(const std::string& filename);
-        void loadTexture(const std::string& filename);
+        void loadTexture(const std::string& filename, AssetLoader& loader);
     };
 }
 
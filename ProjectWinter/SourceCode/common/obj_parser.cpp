@@ -0,0 +1,679 @@
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include "mapped_file.h"
+#include "parallel.h"
+// tinyobj still provides LoadObj() for the simple paths and the .mtl reader
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "obj_parser.h"
+
+using namespace std;
+using tinyobj::real_t;
+using tinyobj::index_t;
+
+// Files smaller than this are parsed on the calling thread.
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+
+namespace {
+
+/*
+ * Every helper below works on a single line [p, end) of the mapped file.
+ * Reading at `end` behaves like reading the '\0' that terminates the line
+ * buffer inside tinyobj, so the parsing rules are exactly tinyobj's.
+ */
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+inline bool isDigit(char c) { return static_cast<unsigned int>(c - '0') < 10u; }
+inline char at(const char* p, const char* end) { return p < end ? *p : '\0'; }
+
+inline void skipSpaces(const char*& p, const char* end) {
+    while (p < end && isSpace(*p)) p++;
+}
+
+// strcspn(p, " \t\r")
+inline const char* fieldEnd(const char* p, const char* end) {
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    return p;
+}
+
+// strcspn(p, "/ \t\r")
+inline const char* indexEnd(const char* p, const char* end) {
+    while (p < end && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    return p;
+}
+
+// atoi() without the need of a terminating '\0'
+inline int parseAtoi(const char* p, const char* end) {
+    while (p < end && (isSpace(*p) || *p == '\v' || *p == '\f')) p++;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+    unsigned int value = 0;
+    while (p < end && isDigit(*p)) {
+        value = value * 10 + static_cast<unsigned int>(*p - '0');
+        p++;
+    }
+    return static_cast<int>(negative ? 0u - value : value);
+}
+
+// Same algorithm as tinyobj's tryParseDouble() so that the parsed floats are
+// bit for bit the same.
+bool tryParseDouble(const char* s, const char* s_end, double* result) {
+    if (s >= s_end) return false;
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    char sign = '+';
+    char exp_sign = '+';
+    const char* curr = s;
+    int read = 0;
+    bool end_not_reached = false;
+
+    if (*curr == '+' || *curr == '-') {
+        sign = *curr;
+        curr++;
+    } else if (!isDigit(*curr)) {
+        return false;
+    }
+
+    // integer part
+    end_not_reached = (curr != s_end);
+    while (end_not_reached && isDigit(*curr)) {
+        mantissa *= 10;
+        mantissa += static_cast<int>(*curr - 0x30);
+        curr++;
+        read++;
+        end_not_reached = (curr != s_end);
+    }
+    if (read == 0) return false;
+    if (!end_not_reached) goto assemble;
+
+    // decimal part
+    if (*curr == '.') {
+        curr++;
+        read = 1;
+        end_not_reached = (curr != s_end);
+        while (end_not_reached && isDigit(*curr)) {
+            static const double pow_lut[] = {
+                1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+            };
+            const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+            mantissa += static_cast<int>(*curr - 0x30) *
+                (read < lut_entries ? pow_lut[read] : pow(10.0, -read));
+            read++;
+            curr++;
+            end_not_reached = (curr != s_end);
+        }
+    } else if (*curr != 'e' && *curr != 'E') {
+        goto assemble;
+    }
+
+    if (!end_not_reached) goto assemble;
+
+    // exponent part
+    if (*curr == 'e' || *curr == 'E') {
+        curr++;
+        end_not_reached = (curr != s_end);
+        if (end_not_reached && (*curr == '+' || *curr == '-')) {
+            exp_sign = *curr;
+            curr++;
+        } else if (!(end_not_reached && isDigit(*curr))) {
+            return false;
+        }
+
+        read = 0;
+        end_not_reached = (curr != s_end);
+        while (end_not_reached && isDigit(*curr)) {
+            exponent *= 10;
+            exponent += static_cast<int>(*curr - 0x30);
+            curr++;
+            read++;
+            end_not_reached = (curr != s_end);
+        }
+        exponent *= (exp_sign == '+' ? 1 : -1);
+        if (read == 0) return false;
+    }
+
+assemble:
+    *result = (sign == '+' ? 1 : -1) *
+        (exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa);
+    return true;
+}
+
+// tinyobj's parseReal(): the next field, or `def` if it isn't a number
+inline real_t parseReal(const char*& p, const char* end, double def = 0.0) {
+    skipSpaces(p, end);
+    const char* e = fieldEnd(p, end);
+    double val = def;
+    tryParseDouble(p, e, &val);
+    p = e;
+    return static_cast<real_t>(val);
+}
+
+inline int parseInt(const char*& p, const char* end) {
+    skipSpaces(p, end);
+    int i = parseAtoi(p, end);
+    p = fieldEnd(p, end);
+    return i;
+}
+
+inline string parseString(const char*& p, const char* end) {
+    skipSpaces(p, end);
+    const char* e = fieldEnd(p, end);
+    string s(p, e);
+    p = e;
+    return s;
+}
+
+struct Event {
+    enum Type { USEMTL, MTLLIB, GROUP, OBJECT, TAG } type;
+    size_t faces;   // faces of the chunk before this line
+    size_t corners; // triangle corners of the chunk before this line
+    const char* begin;
+    const char* end;
+};
+
+struct FaceVertex {
+    index_t index;
+    unsigned char relative; // bit per component that still needs the chunk base
+};
+
+struct Chunk {
+    const char* begin;
+    const char* end;
+
+    vector<real_t> v, vn, vt, vc;
+    vector<index_t> corners;
+    // corner * 3 + component of every relative (negative) index; those are
+    // relative to the chunk and get the attribute count of the previous
+    // chunks added once all chunks are parsed
+    vector<size_t> fixups;
+    vector<Event> events;
+    vector<FaceVertex> face;
+    size_t faces;
+    bool failed;
+
+    Chunk() : begin(nullptr), end(nullptr), faces(0), failed(false) {}
+};
+
+// tinyobj's fixIndex(), negative indices are resolved against the chunk
+inline bool fixIndex(int idx, size_t n, int& out, unsigned char& relative, unsigned char bit) {
+    if (idx > 0) {
+        out = idx - 1;
+        return true;
+    }
+    if (idx == 0) return false;
+    out = static_cast<int>(n) + idx;
+    relative |= bit;
+    return true;
+}
+
+enum { REL_V = 1, REL_VN = 2, REL_VT = 4 };
+
+// i, i/j/k, i//k, i/j
+bool parseTriple(const char*& p, const char* end, const Chunk& c, FaceVertex& fv) {
+    fv.index.vertex_index = -1;
+    fv.index.normal_index = -1;
+    fv.index.texcoord_index = -1;
+    fv.relative = 0;
+
+    if (!fixIndex(parseAtoi(p, end), c.v.size() / 3, fv.index.vertex_index, fv.relative, REL_V))
+        return false;
+    p = indexEnd(p, end);
+    if (at(p, end) != '/') return true;
+    p++;
+
+    // i//k
+    if (at(p, end) == '/') {
+        p++;
+        if (!fixIndex(parseAtoi(p, end), c.vn.size() / 3, fv.index.normal_index, fv.relative, REL_VN))
+            return false;
+        p = indexEnd(p, end);
+        return true;
+    }
+
+    // i/j/k or i/j
+    if (!fixIndex(parseAtoi(p, end), c.vt.size() / 2, fv.index.texcoord_index, fv.relative, REL_VT))
+        return false;
+    p = indexEnd(p, end);
+    if (at(p, end) != '/') return true;
+
+    // i/j/k
+    p++;
+    if (!fixIndex(parseAtoi(p, end), c.vn.size() / 3, fv.index.normal_index, fv.relative, REL_VN))
+        return false;
+    p = indexEnd(p, end);
+    return true;
+}
+
+inline void pushCorner(Chunk& c, const FaceVertex& fv) {
+    if (fv.relative) {
+        size_t corner = c.corners.size();
+        if (fv.relative & REL_V) c.fixups.push_back(corner * 3 + 0);
+        if (fv.relative & REL_VN) c.fixups.push_back(corner * 3 + 1);
+        if (fv.relative & REL_VT) c.fixups.push_back(corner * 3 + 2);
+    }
+    c.corners.push_back(fv.index);
+}
+
+inline bool startsWith(const char* p, const char* end, const char* keyword, size_t n) {
+    return static_cast<size_t>(end - p) > n && memcmp(p, keyword, n) == 0 && isSpace(p[n]);
+}
+
+inline void addEvent(Chunk& c, Event::Type type, const char* begin, const char* end) {
+    Event e = {type, c.faces, c.corners.size(), begin, end};
+    c.events.push_back(e);
+}
+
+void parseLine(Chunk& c, const char* p, const char* end) {
+    skipSpaces(p, end);
+    if (p >= end || *p == '#') return;
+
+    char c0 = p[0];
+    char c1 = at(p + 1, end);
+    char c2 = at(p + 2, end);
+
+    // vertex
+    if (c0 == 'v' && isSpace(c1)) {
+        p += 2;
+        real_t x = parseReal(p, end);
+        real_t y = parseReal(p, end);
+        real_t z = parseReal(p, end);
+        real_t r = parseReal(p, end, 1.0);
+        real_t g = parseReal(p, end, 1.0);
+        real_t b = parseReal(p, end, 1.0);
+        c.v.push_back(x);
+        c.v.push_back(y);
+        c.v.push_back(z);
+        c.vc.push_back(r);
+        c.vc.push_back(g);
+        c.vc.push_back(b);
+        return;
+    }
+
+    // normal
+    if (c0 == 'v' && c1 == 'n' && isSpace(c2)) {
+        p += 3;
+        real_t x = parseReal(p, end);
+        real_t y = parseReal(p, end);
+        real_t z = parseReal(p, end);
+        c.vn.push_back(x);
+        c.vn.push_back(y);
+        c.vn.push_back(z);
+        return;
+    }
+
+    // texcoord
+    if (c0 == 'v' && c1 == 't' && isSpace(c2)) {
+        p += 3;
+        real_t x = parseReal(p, end);
+        real_t y = parseReal(p, end);
+        c.vt.push_back(x);
+        c.vt.push_back(y);
+        return;
+    }
+
+    // face, triangulated as a fan like tinyobj does
+    if (c0 == 'f' && isSpace(c1)) {
+        p += 2;
+        skipSpaces(p, end);
+
+        c.face.clear();
+        while (p < end) {
+            FaceVertex fv;
+            if (!parseTriple(p, end, c, fv)) {
+                c.failed = true;
+                return;
+            }
+            c.face.push_back(fv);
+            while (p < end && (isSpace(*p) || *p == '\r')) p++;
+        }
+
+        for (size_t k = 2; k < c.face.size(); k++) {
+            pushCorner(c, c.face[0]);
+            pushCorner(c, c.face[k - 1]);
+            pushCorner(c, c.face[k]);
+        }
+        c.faces++;
+        return;
+    }
+
+    // everything else changes the shape/material state, which depends on the
+    // lines before it, so it is replayed in file order after the parallel pass
+    if (startsWith(p, end, "usemtl", 6)) {
+        addEvent(c, Event::USEMTL, p, end);
+    } else if (startsWith(p, end, "mtllib", 6)) {
+        addEvent(c, Event::MTLLIB, p, end);
+    } else if (c0 == 'g' && isSpace(c1)) {
+        addEvent(c, Event::GROUP, p, end);
+    } else if (c0 == 'o' && isSpace(c1)) {
+        addEvent(c, Event::OBJECT, p, end);
+    } else if (c0 == 't' && isSpace(c1)) {
+        addEvent(c, Event::TAG, p, end);
+    }
+}
+
+void parseChunk(Chunk& c) {
+    // rough guess of ~30 bytes per line to avoid most of the regrowth
+    size_t lines = static_cast<size_t>(c.end - c.begin) / 30;
+    c.v.reserve(lines);
+    c.vc.reserve(lines);
+    c.corners.reserve(lines);
+
+    const char* p = c.begin;
+    while (p < c.end) {
+        const char* lineBegin = p;
+        const char* lineEnd = nullptr;
+        while (p < c.end && *p != '\n' && *p != '\r') {
+            // tinyobj sees the line as a C string, ignore what follows a '\0'
+            if (*p == '\0' && !lineEnd) lineEnd = p;
+            p++;
+        }
+        if (!lineEnd) lineEnd = p;
+
+        // '\n', '\r' or "\r\n"
+        if (p < c.end) {
+            if (*p == '\r' && p + 1 < c.end && p[1] == '\n') p += 2;
+            else p++;
+        }
+
+        parseLine(c, lineBegin, lineEnd);
+        if (c.failed) return;
+    }
+}
+
+struct Segment {
+    const Chunk* chunk;
+    size_t begin, end;
+};
+
+/*
+ * Replays usemtl/mtllib/g/o/t lines in file order, producing exactly the
+ * shapes tinyobj::LoadObj() would.
+ */
+class ShapeBuilder {
+public:
+    ShapeBuilder(vector<tinyobj::shape_t>* shapes, vector<tinyobj::material_t>* materials,
+                 string* err, const string& mtlBaseDir)
+        : shapes(shapes), materials(materials), err(err), pendingFaces(0),
+        material(-1), matFileReader(mtlBaseDir) {}
+
+    void addFaces(const Chunk* chunk, size_t begin, size_t end, size_t faces) {
+        pendingFaces += faces;
+        if (end > begin) {
+            Segment s = {chunk, begin, end};
+            pending.push_back(s);
+        }
+    }
+
+    void handle(const Event& e) {
+        switch (e.type) {
+            case Event::USEMTL: useMaterial(e); break;
+            case Event::MTLLIB: loadMaterials(e); break;
+            case Event::GROUP: group(e); break;
+            case Event::OBJECT: object(e); break;
+            case Event::TAG: tag(e); break;
+        }
+    }
+
+    void finish() {
+        bool ret = exportFaceGroup();
+        if (ret || shape.mesh.indices.size()) {
+            shapes->push_back(std::move(shape));
+        }
+        clearFaceGroup();
+    }
+
+private:
+    // tinyobj's exportFaceGroupToShape()
+    bool exportFaceGroup() {
+        if (pendingFaces == 0) return false;
+
+        size_t corners = 0;
+        for (const auto& s : pending) corners += s.end - s.begin;
+
+        tinyobj::mesh_t& mesh = shape.mesh;
+        mesh.indices.reserve(mesh.indices.size() + corners);
+        mesh.num_face_vertices.reserve(mesh.num_face_vertices.size() + corners / 3);
+        mesh.material_ids.reserve(mesh.material_ids.size() + corners / 3);
+        for (const auto& s : pending) {
+            const auto& src = s.chunk->corners;
+            mesh.indices.insert(mesh.indices.end(), src.begin() + s.begin, src.begin() + s.end);
+            size_t triangles = (s.end - s.begin) / 3;
+            mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), triangles, 3);
+            mesh.material_ids.insert(mesh.material_ids.end(), triangles, material);
+        }
+
+        shape.name = name;
+        shape.mesh.tags = tags;
+        return true;
+    }
+
+    void clearFaceGroup() {
+        pending.clear();
+        pendingFaces = 0;
+    }
+
+    void useMaterial(const Event& e) {
+        string namebuf(min(e.begin + 7, e.end), e.end);
+
+        int newMaterialId = -1;
+        map<string, int>::iterator it = materialMap.find(namebuf);
+        if (it != materialMap.end()) newMaterialId = it->second;
+
+        if (newMaterialId != material) {
+            exportFaceGroup();
+            clearFaceGroup();
+            material = newMaterialId;
+        }
+    }
+
+    void loadMaterials(const Event& e) {
+        vector<string> filenames;
+        stringstream ss(string(min(e.begin + 7, e.end), e.end));
+        string item;
+        while (getline(ss, item, ' ')) filenames.push_back(item);
+
+        if (filenames.empty()) {
+            if (err) {
+                (*err) += "WARN: Looks like empty filename for mtllib. Use default "
+                    "material. \n";
+            }
+            return;
+        }
+
+        bool found = false;
+        for (size_t s = 0; s < filenames.size(); s++) {
+            string err_mtl;
+            bool ok = matFileReader(filenames[s].c_str(), materials, &materialMap, &err_mtl);
+            if (err && !err_mtl.empty()) (*err) += err_mtl;
+            if (ok) {
+                found = true;
+                break;
+            }
+        }
+        if (!found && err) {
+            (*err) += "WARN: Failed to load material file(s). Use default material.\n";
+        }
+    }
+
+    void group(const Event& e) {
+        exportFaceGroup();
+        if (shape.mesh.indices.size() > 0) shapes->push_back(std::move(shape));
+        shape = tinyobj::shape_t();
+        clearFaceGroup();
+
+        // names[0] is the 'g' itself, only the first real name is kept
+        const char* p = e.begin;
+        parseString(p, e.end);
+        while (p < e.end && (isSpace(*p) || *p == '\r')) p++;
+        name = p < e.end ? parseString(p, e.end) : "";
+    }
+
+    void object(const Event& e) {
+        bool ret = exportFaceGroup();
+        if (ret) shapes->push_back(std::move(shape));
+        clearFaceGroup();
+        shape = tinyobj::shape_t();
+
+        name = string(min(e.begin + 2, e.end), e.end);
+    }
+
+    void tag(const Event& e) {
+        const char* p = e.begin + 2;
+        const char* end = e.end;
+
+        tinyobj::tag_t tag;
+        tag.name = parseString(p, end);
+
+        // num_ints/num_reals/num_strings
+        int sizes[3] = {0, 0, 0};
+        skipSpaces(p, end);
+        sizes[0] = parseAtoi(p, end);
+        p = indexEnd(p, end);
+        if (at(p, end) == '/') {
+            p++;
+            skipSpaces(p, end);
+            sizes[1] = parseAtoi(p, end);
+            p = indexEnd(p, end);
+            if (at(p, end) == '/') {
+                p++;
+                sizes[2] = parseInt(p, end);
+            }
+        }
+
+        tag.intValues.resize(static_cast<size_t>(max(sizes[0], 0)));
+        for (size_t i = 0; i < tag.intValues.size(); ++i) tag.intValues[i] = parseInt(p, end);
+        tag.floatValues.resize(static_cast<size_t>(max(sizes[1], 0)));
+        for (size_t i = 0; i < tag.floatValues.size(); ++i) tag.floatValues[i] = parseReal(p, end);
+        tag.stringValues.resize(static_cast<size_t>(max(sizes[2], 0)));
+        for (size_t i = 0; i < tag.stringValues.size(); ++i) tag.stringValues[i] = parseString(p, end);
+
+        tags.push_back(tag);
+    }
+
+private:
+    vector<tinyobj::shape_t>* shapes;
+    vector<tinyobj::material_t>* materials;
+    string* err;
+
+    vector<Segment> pending;
+    size_t pendingFaces;
+
+    tinyobj::shape_t shape;
+    string name;
+    int material;
+    map<string, int> materialMap;
+    vector<tinyobj::tag_t> tags;
+    tinyobj::MaterialFileReader matFileReader;
+};
+
+// concatenates the per chunk attribute arrays
+void gather(vector<real_t>& out, vector<Chunk>& chunks, vector<real_t> Chunk::* member) {
+    vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        offsets[i + 1] = offsets[i] + (chunks[i].*member).size();
+    }
+    out.resize(offsets.back());
+    parallelFor(chunks.size(), [&](size_t i) {
+        vector<real_t>& src = chunks[i].*member;
+        if (!src.empty()) memcpy(&out[offsets[i]], &src[0], src.size() * sizeof(real_t));
+        vector<real_t>().swap(src);
+    });
+}
+
+} // namespace
+
+bool loadOBJMapped(
+    tinyobj::attrib_t* attrib,
+    vector<tinyobj::shape_t>* shapes,
+    vector<tinyobj::material_t>* materials,
+    string* err,
+    const char* filename,
+    const char* mtl_basedir) {
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    attrib->colors.clear();
+    shapes->clear();
+
+    MappedFile file;
+    if (!file.open(filename)) {
+        if (err) (*err) = string("Cannot open file [") + filename + "]\n";
+        return false;
+    }
+
+    // split the file into line aligned chunks
+    const char* data = file.data();
+    size_t size = file.size();
+    size_t chunkCount = size / OBJ_MIN_CHUNK_SIZE;
+    if (chunkCount > workerCount()) chunkCount = workerCount();
+    if (chunkCount < 1) chunkCount = 1;
+
+    vector<Chunk> chunks(chunkCount);
+    const char* previous = data;
+    for (size_t i = 0; i < chunkCount; i++) {
+        const char* end = data + size;
+        if (i + 1 < chunkCount) {
+            const char* nominal = max(data + size * (i + 1) / chunkCount, previous);
+            const char* newline = static_cast<const char*>(
+                memchr(nominal, '\n', static_cast<size_t>(data + size - nominal)));
+            end = newline ? newline + 1 : data + size;
+        }
+        chunks[i].begin = previous;
+        chunks[i].end = end;
+        previous = end;
+    }
+
+    parallelFor(chunkCount, [&](size_t i) { parseChunk(chunks[i]); });
+
+    // resolve relative indices now that the attribute counts are known
+    size_t vBase = 0, vnBase = 0, vtBase = 0;
+    vector<size_t> bases(chunkCount * 3);
+    for (size_t i = 0; i < chunkCount; i++) {
+        bases[i * 3 + 0] = vBase;
+        bases[i * 3 + 1] = vnBase;
+        bases[i * 3 + 2] = vtBase;
+        vBase += chunks[i].v.size() / 3;
+        vnBase += chunks[i].vn.size() / 3;
+        vtBase += chunks[i].vt.size() / 2;
+    }
+    parallelFor(chunkCount, [&](size_t i) {
+        Chunk& c = chunks[i];
+        for (size_t f : c.fixups) {
+            index_t& idx = c.corners[f / 3];
+            int base = static_cast<int>(bases[i * 3 + f % 3]);
+            if (f % 3 == 0) idx.vertex_index += base;
+            else if (f % 3 == 1) idx.normal_index += base;
+            else idx.texcoord_index += base;
+        }
+    });
+
+    string baseDir = mtl_basedir ? mtl_basedir : "";
+    ShapeBuilder builder(shapes, materials, err, baseDir);
+    for (const auto& c : chunks) {
+        size_t corner = 0, face = 0;
+        for (const auto& e : c.events) {
+            builder.addFaces(&c, corner, e.corners, e.faces - face);
+            corner = e.corners;
+            face = e.faces;
+            builder.handle(e);
+        }
+        if (c.failed) {
+            if (err) (*err) = "Failed parse `f' line(e.g. zero value for face index).\n";
+            return false;
+        }
+        builder.addFaces(&c, corner, c.corners.size(), c.faces - face);
+    }
+    builder.finish();
+
+    gather(attrib->vertices, chunks, &Chunk::v);
+    gather(attrib->normals, chunks, &Chunk::vn);
+    gather(attrib->texcoords, chunks, &Chunk::vt);
+    gather(attrib->colors, chunks, &Chunk::vc);
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <string>
+#include <vector>
+#include <tiny_obj_loader.h>
+
+/**
+* A drop-in replacement for tinyobj::LoadObj() (with triangulation) for large
+* files. The file is memory mapped, split into line aligned chunks and the
+* chunks are tokenized in parallel without per-token allocations. The results
+* (attrib, shapes, materials, err) are identical to what tinyobj produces for
+* the same file; .mtl files are still read through tinyobj.
+*/
+bool loadOBJMapped(
+    tinyobj::attrib_t* attrib,
+    std::vector<tinyobj::shape_t>* shapes,
+    std::vector<tinyobj::material_t>* materials,
+    std::string* err,
+    const char* filename,
+    const char* mtl_basedir = NULL
+);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <exception>
+#include <cstddef>
+
+/**
+* Number of threads used by the parallel loaders (at least 1).
+*/
+inline unsigned int workerCount() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+/**
+* Call fn(i) for every i in [0, count) using up to workerCount() threads. Each
+* thread gets one contiguous range of i, so the caller can rely on fn(i) and
+* fn(i + 1) usually running on the same thread. Blocks until all calls are
+* done. The first exception thrown by fn is rethrown on the calling thread.
+*/
+template<typename F>
+void parallelFor(size_t count, F fn) {
+    size_t threads = workerCount();
+    if (threads > count) threads = count;
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+
+    auto work = [&](size_t t) {
+        size_t begin = count * t / threads;
+        size_t end = count * (t + 1) / threads;
+        try {
+            for (size_t i = begin; i < end; i++) fn(i);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(work, t);
+    work(0);
+    for (auto& th : pool) th.join();
+
+    for (const auto& e : errors) {
+        if (e) std::rethrow_exception(e);
+    }
+}
+
+#endif
@@ -1,4 +1,6 @@
 #include <GL/glew.h>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -6,8 +8,11 @@
 using namespace std;
 
 #include "shader.h"
+#include "gl_state.h"
+#include "util.h"
+#include "mapped_file.h"
 
-void compileShader(GLuint& shaderID, const char* file) {
+std::string readShaderSource(const char* file) {
     // read shader code from the file
     std::string shaderCode;
     std::ifstream shaderStream(file, std::ios::in);
@@ -20,76 +25,287 @@ void compileShader(GLuint& shaderID, const char* file) {
     } else {
         throw runtime_error(string("Can't open shader file: ") + file);
     }
+    return shaderCode;
+}
 
-    GLint result = GL_FALSE;
-    int infoLogLength;
+// adds a #define line for each of `defines` right after the #version line
+static std::string injectDefines(const std::string& source, const std::vector<std::string>& defines) {
+    if (defines.empty()) return source;
+    string lines;
+    for (const string& define : defines) lines += "#define " + define + "\n";
+
+    size_t version = source.find("#version");
+    if (version == string::npos) return lines + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == string::npos) return source + "\n" + lines;
+    return source.substr(0, lineEnd + 1) + lines + source.substr(lineEnd + 1);
+}
 
-    // compile Vertex Shader
+// "file (A, B)" for the logs
+static std::string variantName(const std::string& file, const std::vector<std::string>& defines) {
+    if (defines.empty()) return file;
+    string name = file + " (";
+    for (size_t i = 0; i < defines.size(); i++) name += (i ? ", " : "") + defines[i];
+    return name + ")";
+}
+
+// starts the compile, checkShader() waits for it
+static void submitShader(GLuint shaderID, const std::string& file, const std::string& shaderCode) {
     cout << "Compiling shader: " << file << endl;
     char const* sourcePointer = shaderCode.c_str();
     glShaderSource(shaderID, 1, &sourcePointer, NULL);
     glCompileShader(shaderID);
+}
 
-    // check Vertex Shader
+static void checkShader(GLuint shaderID, const std::string& file) {
+    GLint result = GL_FALSE;
+    int infoLogLength;
+
+    // check the shader
     glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
     glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
     if (infoLogLength > 0) {
         std::vector<char> shaderErrorMessage(infoLogLength + 1);
         glGetShaderInfoLog(shaderID, infoLogLength, NULL, &shaderErrorMessage[0]);
         //throw runtime_error(string(&shaderErrorMessage[0]));
-        cout << &shaderErrorMessage[0] << endl;
+        cout << file << ": " << &shaderErrorMessage[0] << endl;
     }
 }
 
-GLuint loadShaders(const char* vertexFilePath,
-                   const char* fragmentFilePath,
-                   const char* geometryFilePath) {
-    // Create the shaders
-    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    compileShader(vertexShaderID, vertexFilePath);
-
-    GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-    compileShader(fragmentShaderID, fragmentFilePath);
-
-    GLuint geometryShaderID = 0;
-    if (geometryFilePath) {
-        geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
-        compileShader(geometryShaderID, geometryFilePath);
+/*****************************************************************************/
+
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+static const char PROGRAM_CACHE_MAGIC[4] = {'P', 'W', 'P', 'C'};
+
+static bool programCaching = true;
+static size_t programCacheHits = 0, programCacheMisses = 0;
+
+void setProgramCaching(bool enabled) {
+    programCaching = enabled;
+}
+
+void printProgramCacheReport() {
+    cout << "Program cache: " << programCacheHits << " hits, "
+        << programCacheMisses << " misses" << endl;
+}
+
+static bool programBinarySupported() {
+    if (!GLEW_ARB_get_program_binary) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// one cache file per program and variant, named after the shader files and defines
+static string programCachePath(const char* vertexFilePath, const char* fragmentFilePath,
+                               const char* geometryFilePath, const vector<string>& defines) {
+    string files = string(vertexFilePath) + "|" + (geometryFilePath ? geometryFilePath : "");
+    for (const string& define : defines) files += "|" + define;
+    char name[32];
+    snprintf(name, sizeof(name), ".%016llx", (unsigned long long) hashBytes(files.data(), files.size()));
+    return string(fragmentFilePath) + name + ".programcache";
+}
+
+// the sources and the driver that compiled them
+static uint64_t programCacheKey(const vector<string>& sources) {
+    uint64_t key = 0;
+    for (const string& source : sources) {
+        key = hashBytes(source.data(), source.size(), key);
+    }
+    GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (GLenum name : strings) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        if (value) key = hashBytes(value, strlen(value), key);
     }
+    return key;
+}
 
-    // Link the program
-    cout << "Linking shaders... " << endl;
-    GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    if (geometryFilePath)
-        glAttachShader(programID, geometryShaderID);
-    glAttachShader(programID, fragmentShaderID);
-    glLinkProgram(programID);
-
-    // Check the program
+static bool loadProgramBinary(GLuint programID, const string& path, uint64_t key) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    const ProgramCacheHeader* h = reinterpret_cast<const ProgramCacheHeader*>(file.data());
+    if (file.size() < sizeof(ProgramCacheHeader) ||
+        memcmp(h->magic, PROGRAM_CACHE_MAGIC, 4) != 0 ||
+        h->version != PROGRAM_CACHE_VERSION || h->key != key ||
+        file.size() != sizeof(ProgramCacheHeader) + h->length) {
+        return false;
+    }
+
+    // the driver may still reject it, e.g. after an update with the same version string
+    glProgramBinary(programID, h->format, file.data() + sizeof(ProgramCacheHeader), h->length);
     GLint result = GL_FALSE;
-    int infoLogLength;
     glGetProgramiv(programID, GL_LINK_STATUS, &result);
-    glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
-    if (infoLogLength > 0) {
-        std::vector<char> programErrorMessage(infoLogLength + 1);
-        glGetProgramInfoLog(programID, infoLogLength, NULL, &programErrorMessage[0]);
-        //throw runtime_error(string(&programErrorMessage[0]));
-        cout << &programErrorMessage[0] << endl;
+    return result == GL_TRUE;
+}
+
+static void saveProgramBinary(GLuint programID, const string& path, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    ProgramCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PROGRAM_CACHE_MAGIC, 4);
+    h.version = PROGRAM_CACHE_VERSION;
+    h.key = key;
+    vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(programID, length, NULL, &format, &binary[0]);
+    h.format = format;
+    h.length = static_cast<uint32_t>(length);
+
+    // write to a temporary file so a crash never leaves a truncated cache
+    string tmpPath = path + ".tmp";
+    FILE* fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp) {
+        cout << "Can't write program cache: " << path << endl;
+        return;
     }
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+        fwrite(&binary[0], 1, binary.size(), fp) == binary.size();
+    ok = (fclose(fp) == 0) && ok;
 
-    glDetachShader(programID, vertexShaderID);
-    glDeleteShader(vertexShaderID);
+    if (!ok || !replaceFile(tmpPath, path)) {
+        remove(tmpPath.c_str());
+        cout << "Can't write program cache: " << path << endl;
+    }
+}
+
+/*****************************************************************************/
+
+static bool parallelCompileSupported() {
+    static int supported = -1;
+    if (supported < 0) {
+        supported = GLEW_ARB_parallel_shader_compile ? 1 : 0;
+        GLint extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions && !supported; i++) {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && strcmp(name, "GL_KHR_parallel_shader_compile") == 0) supported = 1;
+        }
+        // let the driver pick the number of compiler threads
+        if (GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+    return supported == 1;
+}
+
+ShaderBatch::ShaderBatch() {
+    parallelCompileSupported();
+}
+
+ShaderBatch::~ShaderBatch() {
+    finish();
+}
+
+GLuint ShaderBatch::add(const char* vertexFilePath,
+                        const char* fragmentFilePath,
+                        const char* geometryFilePath,
+                        const std::vector<std::string>& defines) {
+    Pending p;
+    p.files.push_back(vertexFilePath);
+    p.files.push_back(fragmentFilePath);
+    if (geometryFilePath) p.files.push_back(geometryFilePath);
+    p.defines = defines;
+    vector<string> sources;
+    for (const string& file : p.files) {
+        sources.push_back(injectDefines(readShaderSource(file.c_str()), defines));
+    }
+
+    p.caching = programCaching && programBinarySupported();
+    p.key = 0;
+    if (p.caching) {
+        p.cachePath = programCachePath(vertexFilePath, fragmentFilePath, geometryFilePath, defines);
+        p.key = programCacheKey(sources);
+
+        GLuint programID = glCreateProgram();
+        if (loadProgramBinary(programID, p.cachePath, p.key)) {
+            programCacheHits++;
+            cout << "Program cache hit: " << p.cachePath << endl;
+            return programID;
+        }
+        GLState::deleteProgram(programID);
+        programCacheMisses++;
+        cout << "Program cache miss: " << p.cachePath << endl;
+    }
+
+    // Create the shaders, in the order of p.files
+    GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER};
+    for (size_t i = 0; i < p.files.size(); i++) {
+        GLuint shaderID = glCreateShader(types[i]);
+        submitShader(shaderID, variantName(p.files[i], defines), sources[i]);
+        p.shaders.push_back(shaderID);
+    }
 
-    if (geometryFilePath) {
-        glDetachShader(programID, geometryShaderID);
-        glDeleteShader(geometryShaderID);
+    // Link the program, no status query so the compiles don't block here
+    cout << "Linking shaders... " << endl;
+    p.program = glCreateProgram();
+    if (p.caching) glProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    for (GLuint shaderID : p.shaders) glAttachShader(p.program, shaderID);
+    glLinkProgram(p.program);
+
+    pending.push_back(p);
+    return p.program;
+}
+
+bool ShaderBatch::isReady(GLuint program) const {
+    if (!parallelCompileSupported()) return true;
+    for (const Pending& p : pending) {
+        if (p.program != program) continue;
+        GLint done = GL_TRUE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &done);
+        return done == GL_TRUE;
     }
+    return true;
+}
+
+GLuint ShaderBatch::finish(GLuint program) {
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].program != program) continue;
+        Pending p = pending[i];
+        pending.erase(pending.begin() + i);
+
+        for (size_t j = 0; j < p.shaders.size(); j++) checkShader(p.shaders[j], variantName(p.files[j], p.defines));
+
+        // Check the program
+        GLint result = GL_FALSE;
+        int infoLogLength;
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength > 0) {
+            std::vector<char> programErrorMessage(infoLogLength + 1);
+            glGetProgramInfoLog(program, infoLogLength, NULL, &programErrorMessage[0]);
+            //throw runtime_error(string(&programErrorMessage[0]));
+            cout << &programErrorMessage[0] << endl;
+        }
 
-    glDetachShader(programID, fragmentShaderID);
-    glDeleteShader(fragmentShaderID);
+        for (GLuint shaderID : p.shaders) {
+            glDetachShader(program, shaderID);
+            glDeleteShader(shaderID);
+        }
 
-    cout << "Shader program complete." << endl;
+        if (p.caching && result == GL_TRUE) saveProgramBinary(program, p.cachePath, p.key);
 
-    return programID;
-}
\ No newline at end of file
+        cout << "Shader program complete: " << variantName(p.files[1], p.defines) << endl;
+        break;
+    }
+    return program;
+}
+
+void ShaderBatch::finish() {
+    while (!pending.empty()) finish(pending.front().program);
+}
+
+GLuint loadShaders(const char* vertexFilePath,
+                   const char* fragmentFilePath,
+                   const char* geometryFilePath,
+                   const std::vector<std::string>& defines) {
+    ShaderBatch batch;
+    return batch.finish(batch.add(vertexFilePath, fragmentFilePath, geometryFilePath, defines));
+}
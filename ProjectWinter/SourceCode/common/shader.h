@@ -1,8 +1,71 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/**
+* Compiles and links a program. Each of `defines` ("NAME" or "NAME value")
+* becomes a #define line right after the #version line of every stage, so one
+* set of files builds specialised variants.
+*
+* The linked binary is cached next to the fragment shader as
+* <fragment>.<hash>.programcache, one per variant, and loaded with
+* glProgramBinary on the next run, as long as the sources, the
+* PROGRAM_CACHE_VERSION and the GL vendor/renderer/version strings match;
+* otherwise the program is compiled again and the cache rewritten.
+*/
+#define PROGRAM_CACHE_VERSION 1
+
 GLuint loadShaders(const char* vertexFilePath,
                    const char* fragmentFilePath,
-                   const char* geometryFilePath = nullptr);
+                   const char* geometryFilePath = nullptr,
+                   const std::vector<std::string>& defines = std::vector<std::string>());
+
+/**
+* Builds several programs at once. add() submits the compiles and the link
+* without querying their status, so the driver can work on all of them in
+* parallel (on its own threads with KHR/ARB_parallel_shader_compile) while the
+* caller goes on. finish() waits for a program and prints its logs; call it
+* before the first use. Programs still pending are finished by the destructor.
+*/
+class ShaderBatch {
+public:
+    ShaderBatch();
+    ~ShaderBatch();
+    ShaderBatch(const ShaderBatch&) = delete;
+
+    /* Same arguments as loadShaders(), returns the program */
+    GLuint add(const char* vertexFilePath,
+               const char* fragmentFilePath,
+               const char* geometryFilePath = nullptr,
+               const std::vector<std::string>& defines = std::vector<std::string>());
+
+    /* Whether finish() would not wait, always true without the extension */
+    bool isReady(GLuint program) const;
+
+    /* Waits for one or all programs and checks them, returns `program` */
+    GLuint finish(GLuint program);
+    void finish();
+
+private:
+    struct Pending {
+        GLuint program;
+        std::vector<GLuint> shaders;
+        std::vector<std::string> files; // vertex, fragment[, geometry]
+        std::vector<std::string> defines;
+        bool caching;
+        std::string cachePath;
+        uint64_t key;
+    };
+    std::vector<Pending> pending;
+};
+
+/* Whether loadShaders() uses the program cache, default on if the driver can */
+void setProgramCaching(bool enabled);
+
+/* Prints the hits and misses of the program cache */
+void printProgramCacheReport();
 
 #endif
\ No newline at end of file
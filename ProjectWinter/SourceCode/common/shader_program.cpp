@@ -0,0 +1,142 @@
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "shader_program.h"
+#include "gl_state.h"
+
+using namespace std;
+using namespace glm;
+
+static ShaderProgram::UploadStats frameStats = {0, 0};
+static ShaderProgram::UploadStats previousFrameStats = {0, 0};
+
+// components of a uniform type, samplers and everything not listed are one int
+static void uniformFormat(GLenum type, bool& isFloat, size_t& components) {
+    isFloat = true;
+    switch (type) {
+    case GL_FLOAT: components = 1; return;
+    case GL_FLOAT_VEC2: components = 2; return;
+    case GL_FLOAT_VEC3: components = 3; return;
+    case GL_FLOAT_VEC4: components = 4; return;
+    case GL_FLOAT_MAT2: components = 4; return;
+    case GL_FLOAT_MAT3: components = 9; return;
+    case GL_FLOAT_MAT4: components = 16; return;
+    }
+    isFloat = false;
+    switch (type) {
+    case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2: components = 2; return;
+    case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3: components = 3; return;
+    case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: components = 4; return;
+    default: components = 1; return;
+    }
+}
+
+ShaderProgram::ShaderProgram(GLuint program) : program(program) {
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    vector<char> name(maxLength + 1);
+
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program, i, (GLsizei) name.size(), NULL, &size, &type, &name[0]);
+
+        // members of uniform blocks have no location
+        Uniform u;
+        u.name = &name[0];
+        u.location = glGetUniformLocation(program, u.name.c_str());
+        if (u.location < 0) continue;
+        size_t bracket = u.name.find("[0]");
+        if (bracket != string::npos) u.name.erase(bracket);
+
+        size_t components;
+        uniformFormat(type, u.isFloat, components);
+        u.bytes = components * 4;
+        u.offset = values.size();
+        values.resize(values.size() + u.bytes);
+        uniforms.push_back(u);
+    }
+    sort(uniforms.begin(), uniforms.end(),
+         [](const Uniform& a, const Uniform& b) { return a.name < b.name; });
+
+    // start from the values the program has now (0 or the GLSL initializer)
+    for (const Uniform& u : uniforms) {
+        if (u.isFloat) {
+            glGetUniformfv(program, u.location, reinterpret_cast<GLfloat*>(&values[u.offset]));
+        } else {
+            glGetUniformiv(program, u.location, reinterpret_cast<GLint*>(&values[u.offset]));
+        }
+    }
+}
+
+ShaderProgram::~ShaderProgram() {
+    GLState::deleteProgram(program);
+}
+
+void ShaderProgram::use() const {
+    GLState::useProgram(program);
+}
+
+const ShaderProgram::Uniform* ShaderProgram::find(const char* name) const {
+    auto it = lower_bound(uniforms.begin(), uniforms.end(), name,
+                          [](const Uniform& u, const char* n) { return strcmp(u.name.c_str(), n) < 0; });
+    if (it == uniforms.end() || it->name != name) return nullptr;
+    return &*it;
+}
+
+GLint ShaderProgram::location(const char* name) const {
+    const Uniform* u = find(name);
+    return u ? u->location : -1;
+}
+
+GLint ShaderProgram::update(const char* name, bool isFloat, size_t bytes, const void* value) {
+    const Uniform* u = find(name);
+    if (!u) return -1;
+    if (u->isFloat != isFloat || u->bytes != bytes) {
+        throw runtime_error(string("ShaderProgram: wrong type for uniform ") + name);
+    }
+
+    unsigned char* shadow = &values[u->offset];
+    if (memcmp(shadow, value, bytes) == 0) {
+        frameStats.skipped++;
+        return -1;
+    }
+    memcpy(shadow, value, bytes);
+    frameStats.issued++;
+    return u->location;
+}
+
+void ShaderProgram::set(const char* name, int value) {
+    GLint location = update(name, false, sizeof(value), &value);
+    if (location >= 0) glUniform1i(location, value);
+}
+
+void ShaderProgram::set(const char* name, float value) {
+    GLint location = update(name, true, sizeof(value), &value);
+    if (location >= 0) glUniform1f(location, value);
+}
+
+void ShaderProgram::set(const char* name, const vec3& value) {
+    GLint location = update(name, true, sizeof(value), &value[0]);
+    if (location >= 0) glUniform3fv(location, 1, &value[0]);
+}
+
+void ShaderProgram::set(const char* name, const vec4& value) {
+    GLint location = update(name, true, sizeof(value), &value[0]);
+    if (location >= 0) glUniform4fv(location, 1, &value[0]);
+}
+
+void ShaderProgram::set(const char* name, const mat4& value) {
+    GLint location = update(name, true, sizeof(value), &value[0][0]);
+    if (location >= 0) glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+void ShaderProgram::endFrame() {
+    previousFrameStats = frameStats;
+    frameStats.issued = frameStats.skipped = 0;
+}
+
+ShaderProgram::UploadStats ShaderProgram::lastFrameStats() {
+    return previousFrameStats;
+}
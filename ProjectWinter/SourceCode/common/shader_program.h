@@ -0,0 +1,63 @@
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+/**
+* A linked program (see loadShaders()) with its active uniforms enumerated
+* once with glGetActiveUniform, so uniforms are set by name instead of through
+* hand kept locations. The last value of every uniform is shadowed on the CPU
+* (seeded with its current value) and a set() that doesn't change it issues
+* no GL call. Names that aren't active in the program, e.g. optimized out or
+* missing from a variant, are ignored. Of arrays only element 0 is tracked.
+* Takes ownership of the program.
+*/
+class ShaderProgram {
+public:
+    explicit ShaderProgram(GLuint program);
+    ~ShaderProgram();
+    ShaderProgram(const ShaderProgram&) = delete;
+
+    GLuint id() const { return program; }
+    void use() const;
+
+    /* Location of an active uniform, -1 if there is none */
+    GLint location(const char* name) const;
+
+    /* The program must be current (use()). A type mismatch throws. */
+    void set(const char* name, int value);
+    void set(const char* name, float value);
+    void set(const char* name, const glm::vec3& value);
+    void set(const char* name, const glm::vec4& value);
+    void set(const char* name, const glm::mat4& value);
+
+    /* Uploads issued and skipped as unchanged, summed over all programs */
+    struct UploadStats {
+        size_t issued, skipped;
+    };
+    /* Ends a frame: its counts become lastFrameStats() and restart at 0 */
+    static void endFrame();
+    static UploadStats lastFrameStats();
+
+private:
+    struct Uniform {
+        std::string name;
+        GLint location;
+        bool isFloat;  // float components, otherwise int (int, bool, samplers)
+        size_t bytes;  // of one element
+        size_t offset; // in values
+    };
+
+    const Uniform* find(const char* name) const;
+    // the location to upload to, or -1 if the set is a no-op
+    GLint update(const char* name, bool isFloat, size_t bytes, const void* value);
+
+    GLuint program;
+    std::vector<Uniform> uniforms; // sorted by name
+    std::vector<unsigned char> values;
+};
+
+#endif
@@ -2,20 +2,41 @@
 #include <glfw3.h>
 #include <SOIL.h>
 #include <string.h>
+#include <stdint.h>
+#include <algorithm>
 #include <iostream>
 #include "texture.h"
+#include "gl_state.h"
+#include "texture_cache.h"
 using namespace std;
 
+// `load()`s the texture of `imagePath`, or uploads it from the texture cache
+template<typename F>
+static GLuint loadCached(const char* imagePath, const char* flags, F load) {
+    if (!textureCaching()) return load();
+    uint64_t key = TextureCache::key({imagePath}, flags);
+    TextureCache cache;
+    if (key && cache.open(key)) {
+        cout << "Texture cache hit: " << imagePath << endl;
+        return cache.upload();
+    }
+    cout << "Texture cache miss: " << imagePath << endl;
+    GLuint texture = load();
+    TextureCache::save(key, GL_TEXTURE_2D, texture);
+    return texture;
+}
+
 GLuint loadBMP(const char* imagePath) {
     cout << "Reading image: " << imagePath << endl;
+    return loadCached(imagePath, TEXTURE_CACHE_BMP, [&] { return uploadBMP(decodeBMP(imagePath)); });
+}
 
+Image decodeBMP(const char* imagePath) {
     // Data read from the header of the BMP file
     unsigned char header[54];
     unsigned int dataPos;
     unsigned int imageSize;
     unsigned int width, height;
-    // Actual RGB data
-    unsigned char * data;
 
     // Open the file
     FILE * file = fopen(imagePath, "rb");
@@ -53,35 +74,41 @@ GLuint loadBMP(const char* imagePath) {
 
     // Some BMP files are misformatted, guess missing information
     if (imageSize == 0) {
-        // 3 : one byte for each Red, Green and Blue component
-        imageSize = width*height * 3;
+        // 3 : one byte for each Red, Green and Blue component, rows padded to 4 bytes
+        imageSize = ((width * 3 + 3) & ~3) * height;
     }
 
     if (dataPos == 0) {
         dataPos = 54; // The BMP header is done that way
     }
 
-    // Create a buffer
-    data = new unsigned char[imageSize];
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.channels = 3;
+    image.format = GL_BGR;
+    image.pixels.resize(imageSize);
 
     // Read the actual data from the file into the buffer
-    fread(data, 1, imageSize, file);
+    fread(image.pixels.data(), 1, imageSize, file);
 
     // Everything is in memory now, the file can be closed.
     fclose(file);
 
+    return image;
+}
+
+GLuint uploadBMP(const Image& image) {
     // Create one OpenGL texture
     GLuint textureID;
     glGenTextures(1, &textureID);
 
     // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
 
     // Give the image to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-    // OpenGL has now copied the data. Free our own version
-    delete[] data;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, image.format,
+                 GL_UNSIGNED_BYTE, image.pixels.data());
 
     // Poor filtering, or ...
     //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -99,6 +126,114 @@ GLuint loadBMP(const char* imagePath) {
     return textureID;
 }
 
+Image decodeMaskBMP(const char* imagePath) {
+    Image bmp = decodeBMP(imagePath);
+
+    Image mask;
+    mask.width = bmp.width;
+    mask.height = bmp.height;
+    mask.channels = 1;
+    mask.format = GL_RED;
+    mask.pixels.resize(bmp.width * bmp.height);
+    // BGR rows padded to 4 bytes, red is the last byte of each texel
+    size_t stride = (bmp.width * 3 + 3) & ~3;
+    if (bmp.pixels.size() < stride * bmp.height) {
+        throw runtime_error(string("Not a correct BMP file: ") + imagePath);
+    }
+    for (int y = 0; y < bmp.height; y++) {
+        const unsigned char* row = &bmp.pixels[stride * y];
+        for (int x = 0; x < bmp.width; x++) {
+            mask.pixels[(size_t) y * bmp.width + x] = row[3 * x + 2];
+        }
+    }
+    return mask;
+}
+
+Image packMasks(const vector<const Image*>& masks) {
+    static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    if (masks.empty() || masks.size() > 4) {
+        throw runtime_error("packMasks: 1 to 4 masks expected");
+    }
+
+    Image packed;
+    packed.width = masks[0]->width;
+    packed.height = masks[0]->height;
+    packed.channels = (int) masks.size();
+    packed.format = formats[masks.size() - 1];
+    size_t texels = (size_t) packed.width * packed.height;
+    packed.pixels.resize(texels * packed.channels);
+
+    for (int c = 0; c < packed.channels; c++) {
+        const Image& mask = *masks[c];
+        if (mask.channels != 1 || mask.width != packed.width || mask.height != packed.height) {
+            throw runtime_error("packMasks: masks must be single channel and of the same size");
+        }
+        for (size_t i = 0; i < texels; i++) {
+            packed.pixels[i * packed.channels + c] = mask.pixels[i];
+        }
+    }
+    return packed;
+}
+
+GLuint uploadMasks(const Image& image) {
+    static const GLint internalFormats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+
+    // rows of 1 to 3 byte texels aren't 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[image.channels - 1], image.width, image.height,
+                 0, image.format, GL_UNSIGNED_BYTE, image.pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Trilinear like loadBMP(), the terrain minifies the masks in the distance
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    if (image.channels == 1) {
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    return textureID;
+}
+
+GLuint uploadTextureArray(const vector<const Image*>& layers) {
+    if (layers.empty()) throw runtime_error("uploadTextureArray: no layers");
+    int width = layers[0]->width, height = layers[0]->height;
+    for (const Image* layer : layers) {
+        if (layer->width != width || layer->height != height) {
+            throw runtime_error("uploadTextureArray: layers must be of the same size");
+        }
+    }
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+    // Allocate level 0 of every layer, then fill them one by one
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, width, height, (GLsizei) layers.size(),
+                 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    for (size_t i = 0; i < layers.size(); i++) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint) i, width, height, 1,
+                        layers[i]->format, GL_UNSIGNED_BYTE, layers[i]->pixels.data());
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    // Every layer gets its own mip chain
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    return textureID;
+}
+
 // Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library,
 // or do it yourself (just like loadBMP_custom and loadDDS)
 //GLuint loadTGA_glfw(const char * imagepath){
@@ -124,62 +259,189 @@ GLuint loadBMP(const char* imagePath) {
 //	return textureID;
 //}
 
-#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+// A four character code as it is read from the file (little endian)
+#define FOURCC(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+#define DDS_HEADER_SIZE 124
+#define DDS_DX10_HEADER_SIZE 20
+#define DDPF_FOURCC 0x4
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDSCAPS2_VOLUME 0x200000
+#define DDS_DIMENSION_TEXTURE2D 3
+#define DDS_RESOURCE_MISC_TEXTURECUBE 0x4
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
 
-GLuint loadDDS(const char* imagePath) {
-    unsigned char header[124];
+// The GL format of a legacy (DX9) FourCC, 0 if there is none
+static GLenum fourCCFormat(uint32_t fourCC) {
+    switch (fourCC) {
+    case FOURCC('D', 'X', 'T', '1'): return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case FOURCC('D', 'X', 'T', '3'): return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+    case FOURCC('D', 'X', 'T', '5'): return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case FOURCC('A', 'T', 'I', '1'):
+    case FOURCC('B', 'C', '4', 'U'): return GL_COMPRESSED_RED_RGTC1;
+    case FOURCC('B', 'C', '4', 'S'): return GL_COMPRESSED_SIGNED_RED_RGTC1;
+    case FOURCC('A', 'T', 'I', '2'):
+    case FOURCC('B', 'C', '5', 'U'): return GL_COMPRESSED_RG_RGTC2;
+    case FOURCC('B', 'C', '5', 'S'): return GL_COMPRESSED_SIGNED_RG_RGTC2;
+    default: return 0;
+    }
+}
 
-    FILE *fp;
+// The GL format of a DXGI_FORMAT (DX10 header), typeless ones read as UNORM
+static GLenum dxgiFormat(uint32_t dxgi) {
+    switch (dxgi) {
+    case 70: case 71: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;         // BC1
+    case 72: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+    case 73: case 74: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;         // BC2
+    case 75: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+    case 76: case 77: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;         // BC3
+    case 78: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+    case 79: case 80: return GL_COMPRESSED_RED_RGTC1;                  // BC4
+    case 81: return GL_COMPRESSED_SIGNED_RED_RGTC1;
+    case 82: case 83: return GL_COMPRESSED_RG_RGTC2;                   // BC5
+    case 84: return GL_COMPRESSED_SIGNED_RG_RGTC2;
+    case 94: case 95: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;    // BC6H
+    case 96: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+    case 97: case 98: return GL_COMPRESSED_RGBA_BPTC_UNORM;            // BC7
+    case 99: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+    default: return 0;
+    }
+}
 
-    /* try to open the file */
-    fp = fopen(imagePath, "rb");
-    if (fp == NULL) {
+// Bytes of one 4x4 block
+static unsigned int blockSize(GLenum format) {
+    switch (format) {
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_SIGNED_RED_RGTC1:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+// GLEW 1.13 reads the extension string, which core profiles don't have
+static bool hasExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && strcmp(extension, name) == 0) return true;
+    }
+    return false;
+}
+
+// RGTC is core since GL 3.0, S3TC and BPTC depend on the driver
+static bool driverSupports(GLenum format) {
+    switch (format) {
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return hasExtension("GL_EXT_texture_compression_s3tc");
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return hasExtension("GL_EXT_texture_compression_s3tc") &&
+            (hasExtension("GL_EXT_texture_sRGB") || hasExtension("GL_EXT_texture_compression_s3tc_srgb"));
+    case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+    case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        return GLEW_VERSION_4_2 || hasExtension("GL_ARB_texture_compression_bptc");
+    default:
+        return true;
+    }
+}
+
+GLuint loadDDS(const char* imagePath) {
+    return uploadDDS(decodeDDS(imagePath));
+}
+
+CompressedImage decodeDDS(const char* imagePath) {
+    shared_ptr<MappedFile> file = make_shared<MappedFile>();
+    if (!file->open(imagePath)) {
         throw runtime_error(string("Image could not be opened: ") + imagePath);
     }
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(file->data());
+    size_t fileSize = file->size();
 
     /* verify the type of file */
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        fclose(fp);
-        throw runtime_error("DDS error");
+    if (fileSize < 4 + DDS_HEADER_SIZE || memcmp(bytes, "DDS ", 4) != 0 ||
+        read32(bytes + 4) != DDS_HEADER_SIZE) {
+        throw runtime_error(string("Not a correct DDS file: ") + imagePath);
     }
 
     /* get the surface desc */
-    fread(&header, 124, 1, fp);
-
-    unsigned int height = *(unsigned int*)&(header[8]);
-    unsigned int width = *(unsigned int*)&(header[12]);
-    unsigned int linearSize = *(unsigned int*)&(header[16]);
-    unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-    unsigned int fourCC = *(unsigned int*)&(header[80]);
-
-    unsigned char * buffer;
-    unsigned int bufsize;
-    /* how big is it going to be including all mipmaps? */
-    bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    buffer = (unsigned char*) malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-    /* close the file pointer */
-    fclose(fp);
-
-    unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-    unsigned int format;
-    switch (fourCC) {
-        case FOURCC_DXT1:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-            break;
-        case FOURCC_DXT3:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-            break;
-        case FOURCC_DXT5:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-            break;
-        default:
-            free(buffer);
-            return 0;
+    const unsigned char* header = bytes + 4;
+    CompressedImage image;
+    image.height = (int) read32(header + 8);
+    image.width = (int) read32(header + 12);
+    uint32_t mipMapCount = read32(header + 24);
+    uint32_t pixelFormatFlags = read32(header + 76);
+    uint32_t fourCC = read32(header + 80);
+    uint32_t caps2 = read32(header + 108);
+    size_t dataOffset = 4 + DDS_HEADER_SIZE;
+    if (image.width <= 0 || image.height <= 0) {
+        throw runtime_error(string("Not a correct DDS file: ") + imagePath);
+    }
+
+    image.format = 0;
+    bool is2D = (caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) == 0;
+    if (pixelFormatFlags & DDPF_FOURCC) {
+        if (fourCC == FOURCC('D', 'X', '1', '0')) {
+            if (fileSize < dataOffset + DDS_DX10_HEADER_SIZE) {
+                throw runtime_error(string("Truncated DDS file: ") + imagePath);
+            }
+            const unsigned char* dx10 = bytes + dataOffset;
+            dataOffset += DDS_DX10_HEADER_SIZE;
+            image.format = dxgiFormat(read32(dx10));
+            is2D = is2D && read32(dx10 + 4) == DDS_DIMENSION_TEXTURE2D &&
+                (read32(dx10 + 8) & DDS_RESOURCE_MISC_TEXTURECUBE) == 0 && read32(dx10 + 12) <= 1;
+        } else {
+            image.format = fourCCFormat(fourCC);
+        }
+    }
+    if (!is2D) image.format = 0;
+
+    // Exact level sizes, partial blocks included; never more levels than down to 1x1
+    image.levels = 0;
+    image.levelOffsets.push_back(0);
+    if (image.format != 0) {
+        int chain = 1;
+        while ((std::max(image.width, image.height) >> chain) > 0) chain++;
+        image.levels = std::min(std::max((int) mipMapCount, 1), chain);
+        size_t offset = 0;
+        for (int level = 0; level < image.levels; level++) {
+            size_t width = std::max(image.width >> level, 1);
+            size_t height = std::max(image.height >> level, 1);
+            offset += ((width + 3) / 4) * ((height + 3) / 4) * blockSize(image.format);
+            image.levelOffsets.push_back(offset);
+        }
+        if (dataOffset + offset > fileSize) {
+            throw runtime_error(string("Truncated DDS file: ") + imagePath);
+        }
+    }
+    image.data = bytes + dataOffset;
+    image.file = file;
+
+    return image;
+}
+
+GLuint uploadDDS(const CompressedImage& image) {
+    if (image.format == 0) {
+        cout << "DDS error: unsupported format" << endl;
+        return 0;
+    }
+    if (!driverSupports(image.format)) {
+        cout << "DDS error: format 0x" << hex << image.format << dec
+             << " is not supported by the driver" << endl;
+        return 0;
     }
 
     // Create one OpenGL texture
@@ -187,35 +449,75 @@ GLuint loadDDS(const char* imagePath) {
     glGenTextures(1, &textureID);
 
     // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+
+    /* load the mipmaps, straight from the mapped file */
+    for (int level = 0; level < image.levels; ++level) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format,
+                               std::max(image.width >> level, 1), std::max(image.height >> level, 1),
+                               0, (GLsizei) image.levelSize(level),
+                               image.data + image.levelOffsets[level]);
+    }
 
-    unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = 0;
+    // Trilinear over the levels in the file, the cooker writes the full chain
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    image.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
 
-    /* load the mipmaps */
-    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) {
-        unsigned int size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
-                               0, size, buffer + offset);
+    if (image.format == GL_COMPRESSED_RED_RGTC1 || image.format == GL_COMPRESSED_SIGNED_RED_RGTC1) {
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
 
-        offset += size;
-        width /= 2;
-        height /= 2;
+    return textureID;
+}
 
-        // Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-        if (width < 1) width = 1;
-        if (height < 1) height = 1;
+GLuint uploadTextureArray(const vector<const CompressedImage*>& layers) {
+    if (layers.empty()) throw runtime_error("uploadTextureArray: no layers");
+    const CompressedImage& first = *layers[0];
+    for (const CompressedImage* layer : layers) {
+        if (layer->width != first.width || layer->height != first.height ||
+            layer->format != first.format || layer->levels != first.levels || layer->format == 0) {
+            throw runtime_error("uploadTextureArray: .dds layers must be of the same size and format");
+        }
+    }
+    if (!driverSupports(first.format)) {
+        cout << "DDS error: format 0x" << hex << first.format << dec
+             << " is not supported by the driver" << endl;
+        return 0;
     }
 
-    free(buffer);
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+    // Allocate each level of every layer, then fill them one by one
+    GLsizei depth = (GLsizei) layers.size();
+    for (int level = 0; level < first.levels; ++level) {
+        GLsizei width = std::max(first.width >> level, 1), height = std::max(first.height >> level, 1);
+        GLsizei size = (GLsizei) first.levelSize(level);
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, first.format, width, height, depth,
+                               0, size * depth, NULL);
+        for (GLsizei i = 0; i < depth; i++) {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, i, width, height, 1,
+                                      first.format, size, layers[i]->data + layers[i]->levelOffsets[level]);
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    first.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, first.levels - 1);
 
     return textureID;
 }
 
-GLuint loadSOIL(const char* imagePath) {
-    cout << "Reading image: " << imagePath << endl;
-
+static GLuint loadSOILTexture(const char* imagePath) {
     GLuint texture = 0;
 
     //Load Image File Directly into an OpenGL Texture
@@ -226,6 +528,7 @@ GLuint loadSOIL(const char* imagePath) {
         SOIL_CREATE_NEW_ID,
         SOIL_FLAG_TEXTURE_REPEATS | SOIL_FLAG_POWER_OF_TWO
     );
+    GLState::invalidate(); // SOIL binds the texture it creates
 
     // error check
     if (texture == 0) {
@@ -233,4 +536,46 @@ GLuint loadSOIL(const char* imagePath) {
     }
 
     return texture;
-}
\ No newline at end of file
+}
+
+GLuint loadSOIL(const char* imagePath) {
+    cout << "Reading image: " << imagePath << endl;
+    return loadCached(imagePath, TEXTURE_CACHE_SOIL, [&] { return loadSOILTexture(imagePath); });
+}
+
+Image decodeSOIL(const char* imagePath) {
+    Image image;
+    image.format = GL_RGB;
+    unsigned char* data = SOIL_load_image(imagePath, &image.width, &image.height,
+                                          &image.channels, SOIL_LOAD_RGB);
+    if (!data) {
+        image.width = image.height = image.channels = 0;
+        return image;
+    }
+    // SOIL_LOAD_RGB always converts to 3 channels
+    image.channels = 3;
+    image.pixels.assign(data, data + image.width * image.height * 3);
+    SOIL_free_image_data(data);
+    return image;
+}
+
+GLuint uploadSOIL(const Image& image) {
+    if (image.pixels.empty()) {
+        cout << "SOIL loading error: " << SOIL_last_result() << endl;
+        return 0;
+    }
+
+    GLuint texture = SOIL_create_OGL_texture(
+        image.pixels.data(), image.width, image.height, image.channels,
+        SOIL_CREATE_NEW_ID,
+        SOIL_FLAG_TEXTURE_REPEATS | SOIL_FLAG_POWER_OF_TWO
+    );
+    GLState::invalidate(); // SOIL binds the texture it creates
+
+    // error check
+    if (texture == 0) {
+        cout << "SOIL loading error: " << SOIL_last_result() << endl;
+    }
+
+    return texture;
+}
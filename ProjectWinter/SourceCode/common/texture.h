@@ -2,17 +2,81 @@
 #define TEXTURE_H
 
 #include <GL/glew.h>
+#include <vector>
+#include <memory>
+#include "mapped_file.h"
 
 /**
-* A simple .bmp loader. Use loadSOIL() instead.
+* An image decoded into memory. Decoding doesn't touch OpenGL, so it can run
+* on any thread; only the upload has to happen on the GL thread.
+*/
+struct Image {
+    int width, height, channels;
+    GLenum format; // GL_BGR (BMP), GL_RGB (SOIL) or GL_RED..GL_RGBA (masks)
+    std::vector<unsigned char> pixels;
+};
+
+/**
+* A simple .bmp loader. Use loadSOIL() instead. Both go through the texture
+* cache, see texture_cache.h.
 */
 GLuint loadBMP(const char* imagePath);
 
+/* The two halves of loadBMP() */
+Image decodeBMP(const char* imagePath);
+GLuint uploadBMP(const Image& image);
+
+/**
+* Masks: single channel images, one byte per texel (GL_RED). packMasks()
+* puts up to four of them into the channels of one image, mask i in channel
+* "rgba"[i], so a shader reads them all with one fetch. uploadMasks() stores
+* 1 to 4 channels as GL_R8 to GL_RGBA8 with mipmaps and trilinear filtering;
+* a lone mask is swizzled to (r, r, r, 1) so it samples like the gray image
+* it was cut from.
+*/
+Image decodeMaskBMP(const char* imagePath); // the red channel of a .bmp
+Image packMasks(const std::vector<const Image*>& masks);
+GLuint uploadMasks(const Image& image);
+
+/**
+* A GL_TEXTURE_2D_ARRAY with image i as layer i. The images must have the same
+* size, their formats may differ (BMP and SOIL). Mipmapped and repeating like
+* uploadBMP(); a shader samples it with vec3(uv, layer).
+*/
+GLuint uploadTextureArray(const std::vector<const Image*>& layers);
+
 /**
-* A .dds loader.
+* A block compressed image in a memory mapped .dds file: its mip levels are
+* read straight from the mapping, which stays open as long as a copy of the
+* image does.
+*/
+struct CompressedImage {
+    int width, height, levels;
+    GLenum format; // GL_COMPRESSED_*, 0 if loadDDS() doesn't know it
+    std::vector<size_t> levelOffsets; // levels + 1 offsets into data, level 0 first
+    const unsigned char* data;
+    std::shared_ptr<MappedFile> file;
+
+    size_t levelSize(int level) const { return levelOffsets[level + 1] - levelOffsets[level]; }
+};
+
+/**
+* A .dds loader: DXT1/3/5 (BC1-3), ATI1/ATI2 and BC4/BC5 (as written by
+* tools/texture_cooker) and, with a DX10 header, BC1-BC7 in their UNORM,
+* SNORM, SRGB and float variants. 2D textures only, no arrays or cube maps.
+* Levels are uploaded from the mapped file without a copy. BC4 is swizzled to
+* (r, r, r, 1) like uploadMasks(). Returns 0 for formats the file or the
+* driver doesn't support, throws for files that aren't valid .dds.
 */
 GLuint loadDDS(const char* imagePath);
 
+/* The two halves of loadDDS() */
+CompressedImage decodeDDS(const char* imagePath);
+GLuint uploadDDS(const CompressedImage& image);
+
+/* uploadTextureArray() for .dds layers of the same size, format and levels */
+GLuint uploadTextureArray(const std::vector<const CompressedImage*>& layers);
+
 /**
 * Readable Image Formats:
 *
@@ -28,4 +92,17 @@ GLuint loadDDS(const char* imagePath);
 */
 GLuint loadSOIL(const char* imagePath);
 
+/* The two halves of loadSOIL(), uploadSOIL() returns 0 on failure */
+Image decodeSOIL(const char* imagePath);
+GLuint uploadSOIL(const Image& image);
+
+/**
+* The texture cache flags of the loaders above (see TextureCache::key()),
+* loaders that make the same texture of a file share them.
+*/
+#define TEXTURE_CACHE_BMP "bmp rgb mipmaps"
+#define TEXTURE_CACHE_SOIL "soil rgb repeats pot"
+#define TEXTURE_CACHE_MASKS "masks mipmaps"
+#define TEXTURE_CACHE_ARRAY "array rgb mipmaps"
+
 #endif
\ No newline at end of file
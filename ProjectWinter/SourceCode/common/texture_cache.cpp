@@ -0,0 +1,246 @@
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "util.h"
+#include "gl_state.h"
+#include "texture_cache.h"
+
+using namespace std;
+
+#define MAX_CACHED_LEVELS 16
+
+struct TextureCache::Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t target;
+    uint32_t internalFormat;
+    uint32_t format, type; // of raw levels, 0 for compressed ones
+    uint32_t compressed;
+    uint32_t width, height, depth;
+    uint32_t levels;
+    int32_t wrapS, wrapT, minFilter, magFilter;
+    int32_t swizzle[4];
+    uint64_t levelSizes[MAX_CACHED_LEVELS];
+};
+
+static const char TEXTURE_CACHE_MAGIC[4] = {'P', 'W', 'T', 'C'};
+
+static bool caching = true;
+static string cacheDirectory = "texturecache";
+static atomic<size_t> cacheHits(0), cacheMisses(0);
+static atomic<uint64_t> cacheBytes(0);
+
+void setTextureCaching(bool enabled) {
+    caching = enabled;
+}
+
+bool textureCaching() {
+    return caching;
+}
+
+void setTextureCacheDirectory(const string& directory) {
+    cacheDirectory = directory;
+}
+
+void printTextureCacheReport() {
+    cout << "Texture cache: " << cacheHits << " hits (" << cacheBytes / (1024.0 * 1024.0)
+        << " MB of levels not decoded or generated), " << cacheMisses << " misses" << endl;
+}
+
+static string entryPath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+    return cacheDirectory + "/" + name + ".texcache";
+}
+
+static uint64_t dataSize(const uint64_t* levelSizes, uint32_t levels) {
+    uint64_t size = 0;
+    for (uint32_t level = 0; level < levels; level++) size += levelSizes[level];
+    return size;
+}
+
+// The client format and texel size GL reads a raw internal format back as
+static bool rawFormat(GLint internalFormat, GLenum& format, size_t& texelBytes) {
+    switch (internalFormat) {
+    case GL_R8: case GL_RED: format = GL_RED; texelBytes = 1; return true;
+    case GL_RG8: case GL_RG: format = GL_RG; texelBytes = 2; return true;
+    case GL_RGB8: case GL_RGB: format = GL_RGB; texelBytes = 3; return true;
+    case GL_RGBA8: case GL_RGBA: format = GL_RGBA; texelBytes = 4; return true;
+    default: return false;
+    }
+}
+
+TextureCache::TextureCache() : header(nullptr) {}
+
+uint64_t TextureCache::key(const vector<string>& sources, const string& flags) {
+    uint64_t key = 0;
+    for (const string& source : sources) {
+        MappedFile file;
+        if (!file.open(source)) return 0;
+        key = hashBytes(file.data(), file.size(), key);
+    }
+    key = hashBytes(flags.data(), flags.size(), key);
+    return key == 0 ? 1 : key;
+}
+
+bool TextureCache::open(uint64_t key) {
+    close();
+    if (file.open(entryPath(key))) {
+        const Header* h = reinterpret_cast<const Header*>(file.data());
+        if (file.size() >= sizeof(Header) &&
+            memcmp(h->magic, TEXTURE_CACHE_MAGIC, 4) == 0 &&
+            h->version == TEXTURE_CACHE_VERSION && h->key == key &&
+            h->levels > 0 && h->levels <= MAX_CACHED_LEVELS &&
+            file.size() == sizeof(Header) + dataSize(h->levelSizes, h->levels)) {
+            header = h;
+            cacheHits++;
+            cacheBytes += dataSize(h->levelSizes, h->levels);
+            return true;
+        }
+    }
+    close();
+    cacheMisses++;
+    return false;
+}
+
+void TextureCache::close() {
+    file.close();
+    header = nullptr;
+}
+
+GLuint TextureCache::upload() const {
+    const Header& h = *header;
+    GLenum target = h.target;
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    GLState::bindTexture(target, textureID);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const char* data = file.data() + sizeof(Header);
+    for (uint32_t level = 0; level < h.levels; level++) {
+        GLsizei width = max<GLsizei>(h.width >> level, 1), height = max<GLsizei>(h.height >> level, 1);
+        GLsizei size = (GLsizei) h.levelSizes[level];
+        if (target == GL_TEXTURE_2D_ARRAY && h.compressed) {
+            glCompressedTexImage3D(target, level, h.internalFormat, width, height, h.depth, 0, size, data);
+        } else if (target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(target, level, h.internalFormat, width, height, h.depth, 0, h.format, h.type, data);
+        } else if (h.compressed) {
+            glCompressedTexImage2D(target, level, h.internalFormat, width, height, 0, size, data);
+        } else {
+            glTexImage2D(target, level, h.internalFormat, width, height, 0, h.format, h.type, data);
+        }
+        data += size;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, h.wrapS);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, h.wrapT);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, h.minFilter);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, h.magFilter);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, h.levels - 1);
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, h.swizzle);
+
+    return textureID;
+}
+
+void TextureCache::save(uint64_t key, GLenum target, GLuint texture) {
+    if (key == 0 || texture == 0) return;
+    string path = entryPath(key);
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TEXTURE_CACHE_MAGIC, 4);
+    h.version = TEXTURE_CACHE_VERSION;
+    h.key = key;
+    h.target = target;
+
+    GLState::bindTexture(target, texture);
+    GLint value = 0, maxLevel = 0;
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_INTERNAL_FORMAT, &value);
+    h.internalFormat = value;
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_COMPRESSED, &value);
+    h.compressed = value;
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &value);
+    h.width = value;
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &value);
+    h.height = value;
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_DEPTH, &value);
+    h.depth = value;
+    glGetTexParameteriv(target, GL_TEXTURE_WRAP_S, &h.wrapS);
+    glGetTexParameteriv(target, GL_TEXTURE_WRAP_T, &h.wrapT);
+    glGetTexParameteriv(target, GL_TEXTURE_MIN_FILTER, &h.minFilter);
+    glGetTexParameteriv(target, GL_TEXTURE_MAG_FILTER, &h.magFilter);
+    glGetTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, h.swizzle);
+    glGetTexParameteriv(target, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+    GLenum format = 0;
+    size_t texelBytes = 0;
+    if (h.width == 0 || (!h.compressed && !rawFormat(h.internalFormat, format, texelBytes))) {
+        cout << "Can't cache texture format 0x" << hex << h.internalFormat << dec << ": " << path << endl;
+        return;
+    }
+    if (!h.compressed) {
+        h.format = format;
+        h.type = GL_UNSIGNED_BYTE;
+    }
+
+    // Every level up to GL_TEXTURE_MAX_LEVEL that has been specified
+    vector<char> data;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (GLint level = 0; level <= maxLevel && level < MAX_CACHED_LEVELS; level++) {
+        GLint width = 0, height = 0;
+        glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0) break;
+
+        size_t size;
+        if (h.compressed) {
+            GLint compressedSize = 0;
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+            size = compressedSize;
+        } else {
+            size = (size_t) width * height * h.depth * texelBytes;
+        }
+        data.resize(data.size() + size);
+        char* levelData = &data[data.size() - size];
+        if (h.compressed) glGetCompressedTexImage(target, level, levelData);
+        else glGetTexImage(target, level, h.format, h.type, levelData);
+
+        h.levelSizes[level] = size;
+        h.levels++;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+#ifdef _WIN32
+    _mkdir(cacheDirectory.c_str());
+#else
+    mkdir(cacheDirectory.c_str(), 0755);
+#endif
+
+    // write to a temporary file so a crash never leaves a truncated cache
+    string tmpPath = path + ".tmp";
+    FILE* fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp) {
+        cout << "Can't write texture cache: " << path << endl;
+        return;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+        (data.empty() || fwrite(&data[0], 1, data.size(), fp) == data.size());
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || !replaceFile(tmpPath, path)) {
+        remove(tmpPath.c_str());
+        cout << "Can't write texture cache: " << path << endl;
+        return;
+    }
+    cout << "Saved texture cache: " << path << " (" << data.size() << " bytes)" << endl;
+}
@@ -0,0 +1,57 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "mapped_file.h"
+
+/**
+* Content addressed cache of finished textures: every level as the GPU got it
+* (raw or compressed, mipmaps included) with the texture parameters, so a
+* later run uploads it as is instead of decoding, resizing and generating
+* mipmaps again. The key hashes the contents of the source files and the
+* loader flags; each entry is one file, <directory>/<key>.texcache, written
+* by reading the texture back after its first upload.
+*/
+#define TEXTURE_CACHE_VERSION 1
+
+class TextureCache {
+public:
+    TextureCache();
+
+    /* The key of the texture `flags` make of `sources`, 0 if a source can't be read */
+    static uint64_t key(const std::vector<std::string>& sources, const std::string& flags);
+
+    /* Maps the entry of `key` and counts a hit, or a miss if there is none */
+    bool open(uint64_t key);
+    void close();
+
+    /* Creates the texture of the open entry (GL thread) */
+    GLuint upload() const;
+
+    /* Reads `texture` back (GL thread) and writes it as the entry of `key`,
+    failures and unsupported formats are only reported */
+    static void save(uint64_t key, GLenum target, GLuint texture);
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+private:
+    struct Header;
+    MappedFile file;
+    const Header* header;
+};
+
+/* Whether the texture loaders use the cache, default on */
+void setTextureCaching(bool enabled);
+bool textureCaching();
+
+/* Where the entries are written, default "texturecache" (created when needed) */
+void setTextureCacheDirectory(const std::string& directory);
+
+/* Prints the hits, misses and the level bytes uploaded from the cache */
+void printTextureCacheReport();
+
+#endif
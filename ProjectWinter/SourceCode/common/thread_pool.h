@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* A fixed set of worker threads running queued tasks in FIFO order. Tasks
+* must not make GL calls, the context belongs to the main thread.
+*/
+class ThreadPool {
+public:
+    /* 0 threads = workerCount() */
+    explicit ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    /* Queues fn, the future rethrows anything fn throws */
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> submit(F fn) {
+        typedef typename std::result_of<F()>::type R;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::move(fn));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks.push_back([task] { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    /* Pool shared by the loaders, created on first use */
+    static ThreadPool& shared();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    void run();
+};
+
+#endif
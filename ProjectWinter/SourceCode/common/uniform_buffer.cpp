@@ -0,0 +1,52 @@
+#include <cstring>
+#include <algorithm>
+#include "uniform_buffer.h"
+
+using namespace std;
+
+UniformBuffer::UniformBuffer(size_t blockSize, size_t slotCount)
+    : blockSize(blockSize), slotCount(slotCount), dirtyBegin(0), dirtyEnd(0), buffer(0) {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    slotSize = (blockSize + alignment - 1) / alignment * alignment;
+    data.resize(slotSize * slotCount);
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, data.size(), &data[0], GL_DYNAMIC_DRAW);
+}
+
+UniformBuffer::~UniformBuffer() {
+    glDeleteBuffers(1, &buffer);
+}
+
+void UniformBuffer::update(size_t slot, const void* block) {
+    unsigned char* dst = &data[slot * slotSize];
+    if (memcmp(dst, block, blockSize) == 0) return;
+    memcpy(dst, block, blockSize);
+
+    size_t begin = slot * slotSize, end = begin + blockSize;
+    if (dirtyBegin == dirtyEnd) {
+        dirtyBegin = begin;
+        dirtyEnd = end;
+    } else {
+        dirtyBegin = std::min(dirtyBegin, begin);
+        dirtyEnd = std::max(dirtyEnd, end);
+    }
+}
+
+void UniformBuffer::flush() {
+    if (dirtyBegin == dirtyEnd) return;
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, dirtyBegin, dirtyEnd - dirtyBegin, &data[dirtyBegin]);
+    dirtyBegin = dirtyEnd = 0;
+}
+
+void UniformBuffer::bind(GLuint binding, size_t slot) const {
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, slot * slotSize, blockSize);
+}
+
+void bindUniformBlock(GLuint program, const char* name, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, binding);
+}
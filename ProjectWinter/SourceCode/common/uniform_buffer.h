@@ -0,0 +1,39 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <GL/glew.h>
+#include <vector>
+
+/**
+* A GL_UNIFORM_BUFFER holding `slotCount` copies of a std140 block of
+* `blockSize` bytes. Every slot starts at a multiple of
+* GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, so a draw picks one with bind() instead
+* of uploading it. update() only writes a CPU copy; flush() sends the slots
+* that changed since the last flush with a single glBufferSubData.
+*/
+class UniformBuffer {
+public:
+    UniformBuffer(size_t blockSize, size_t slotCount = 1);
+    ~UniformBuffer();
+    UniformBuffer(const UniformBuffer&) = delete;
+
+    /* Copies blockSize bytes into a slot, nothing is marked if they're equal */
+    void update(size_t slot, const void* data);
+    void flush();
+
+    /* Binds a slot to a uniform block binding point */
+    void bind(GLuint binding, size_t slot = 0) const;
+
+    GLuint id() const { return buffer; }
+
+private:
+    size_t blockSize, slotSize, slotCount;
+    std::vector<unsigned char> data;
+    size_t dirtyBegin, dirtyEnd; // in bytes, empty if equal
+    GLuint buffer;
+};
+
+/* Points the uniform block `name` of `program` at `binding`, if it has one */
+void bindUniformBlock(GLuint program, const char* name, GLuint binding);
+
+#endif
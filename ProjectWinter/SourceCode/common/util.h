@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 
 /* We can use a function like this to print some GL capabilities of our adapter
 to the log file. handy if we want to debug problems on other people's computers
@@ -41,4 +42,21 @@ std::string getBaseDir(const std::string& filepath);
 */
 bool fileExists(const std::string& abs_filename);
 
+/**
+* Size and last modification time (seconds since epoch) of a file. Returns
+* false if the file doesn't exist.
+*/
+bool fileStat(const std::string& path, uint64_t& size, int64_t& mtime);
+
+/**
+* Move `from` over `to`. rename() replaces the target atomically on POSIX, so
+* readers see either file; only where it can't (Windows) is `to` removed first.
+*/
+bool replaceFile(const std::string& from, const std::string& to);
+
+/**
+* 64-bit non-cryptographic hash of a memory block (xxHash64).
+*/
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
 #endif
\ No newline at end of file
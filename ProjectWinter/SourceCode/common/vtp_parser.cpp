@@ -0,0 +1,373 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+#include <tinyxml2.h>
+#include "mapped_file.h"
+#include "vtp_parser.h"
+
+using namespace std;
+using namespace glm;
+using namespace tinyxml2;
+
+namespace {
+
+/**
+* Everything needed to read the DataArrays of a file.
+*/
+struct VTPContext {
+    string path;
+    size_t headerSize;              // 4 (UInt32) or 8 (UInt64) bytes
+    const unsigned char* appended;  // first byte after the '_' marker
+    const unsigned char* appendedEnd;
+};
+
+[[noreturn]] void fail(const VTPContext& ctx, const string& what) {
+    throw runtime_error(ctx.path + ": " + what);
+}
+
+/*****************************************************************************/
+// ASCII
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+* Parses the number at p and moves p after it. Numbers with at most 15
+* significant digits and a small exponent are converted exactly with one
+* multiplication/division, the rest through strtod() on a stack copy.
+*/
+bool parseNumber(const char*& p, const char* end, double& out) {
+    while (p < end && isSpace(*p)) p++;
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        // nan, inf and friends
+        char buf[32];
+        size_t n = 0;
+        while (start + n < end && n < sizeof(buf) - 1 && !isSpace(start[n])) n++;
+        memcpy(buf, start, n);
+        buf[n] = '\0';
+        char* parsed;
+        out = strtod(buf, &parsed);
+        if (parsed == buf) return false;
+        p = start + (parsed - buf);
+        return true;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool expNegative = false;
+        if (e < end && (*e == '+' || *e == '-')) expNegative = *e++ == '-';
+        if (e < end && *e >= '0' && *e <= '9') {
+            int value = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; e++) {
+                if (value < 100000) value = value * 10 + (*e - '0');
+            }
+            exponent += expNegative ? -value : value;
+            p = e;
+        }
+    }
+
+    if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / POW10[-exponent] : value * POW10[exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+
+    char buf[64];
+    size_t n = std::min(static_cast<size_t>(p - start), sizeof(buf) - 1);
+    memcpy(buf, start, n);
+    buf[n] = '\0';
+    out = strtod(buf, NULL);
+    return true;
+}
+
+template<typename T>
+void readASCII(const VTPContext& ctx, const XMLElement* e, T* out, size_t count) {
+    const char* p = e->GetText();
+    if (!p) p = "";
+    const char* end = p + strlen(p);
+    for (size_t i = 0; i < count; i++) {
+        double value;
+        if (!parseNumber(p, end, value)) {
+            fail(ctx, string("Too few values in DataArray ") +
+                 (e->Attribute("Name") ? e->Attribute("Name") : ""));
+        }
+        out[i] = static_cast<T>(value);
+    }
+}
+
+/*****************************************************************************/
+// binary
+
+inline int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/**
+* Decodes base64 text, skipping whitespace. Padding may also appear in the
+* middle, as some writers encode the header and the data separately.
+*/
+void decodeBase64(const char* p, vector<unsigned char>& out) {
+    out.clear();
+    out.reserve(strlen(p) / 4 * 3);
+    unsigned int quad = 0;
+    int n = 0;
+    for (; *p; p++) {
+        if (*p == '=') {
+            if (n == 2) out.push_back(static_cast<unsigned char>(quad >> 4));
+            if (n == 3) {
+                out.push_back(static_cast<unsigned char>(quad >> 10));
+                out.push_back(static_cast<unsigned char>(quad >> 2));
+            }
+            quad = 0;
+            n = 0;
+            continue;
+        }
+        int v = base64Value(*p);
+        if (v < 0) continue;
+        quad = (quad << 6) | static_cast<unsigned int>(v);
+        if (++n == 4) {
+            out.push_back(static_cast<unsigned char>(quad >> 16));
+            out.push_back(static_cast<unsigned char>(quad >> 8));
+            out.push_back(static_cast<unsigned char>(quad));
+            quad = 0;
+            n = 0;
+        }
+    }
+}
+
+template<typename S, typename T>
+void convert(const unsigned char* data, T* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        S value;
+        memcpy(&value, data + i * sizeof(S), sizeof(S));
+        out[i] = static_cast<T>(value);
+    }
+}
+
+/**
+* Converts `count` values of the VTK `type` at data to T. Float32 into float
+* is a plain copy.
+*/
+template<typename T>
+void convertRaw(const VTPContext& ctx, const string& type,
+                const unsigned char* data, size_t bytes, T* out, size_t count) {
+    size_t size;
+    if (type == "Int8" || type == "UInt8") size = 1;
+    else if (type == "Int16" || type == "UInt16") size = 2;
+    else if (type == "Int32" || type == "UInt32" || type == "Float32") size = 4;
+    else if (type == "Int64" || type == "UInt64" || type == "Float64") size = 8;
+    else fail(ctx, "Unsupported DataArray type " + type);
+    if (bytes < count * size) fail(ctx, "DataArray is shorter than expected");
+
+    if (type == "Float32") {
+        if (is_same<T, float>::value) memcpy(out, data, count * 4);
+        else convert<float>(data, out, count);
+    }
+    else if (type == "Float64") convert<double>(data, out, count);
+    else if (type == "Int8") convert<int8_t>(data, out, count);
+    else if (type == "UInt8") convert<uint8_t>(data, out, count);
+    else if (type == "Int16") convert<int16_t>(data, out, count);
+    else if (type == "UInt16") convert<uint16_t>(data, out, count);
+    else if (type == "Int32") convert<int32_t>(data, out, count);
+    else if (type == "UInt32") convert<uint32_t>(data, out, count);
+    else if (type == "Int64") convert<int64_t>(data, out, count);
+    else convert<uint64_t>(data, out, count);
+}
+
+uint64_t readHeader(const VTPContext& ctx, const unsigned char* p) {
+    if (ctx.headerSize == 4) {
+        uint32_t n;
+        memcpy(&n, p, 4);
+        return n;
+    }
+    uint64_t n;
+    memcpy(&n, p, 8);
+    return n;
+}
+
+/**
+* Reads `count` values of a DataArray in any supported format into out.
+*/
+template<typename T>
+void readDataArray(const VTPContext& ctx, const XMLElement* e, T* out, size_t count) {
+    const char* format = e->Attribute("format");
+    string type = e->Attribute("type") ? e->Attribute("type") : "";
+    if (!format || strcmp(format, "ascii") == 0) {
+        readASCII(ctx, e, out, count);
+    } else if (strcmp(format, "binary") == 0) {
+        vector<unsigned char> bytes;
+        decodeBase64(e->GetText() ? e->GetText() : "", bytes);
+        if (bytes.size() < ctx.headerSize) fail(ctx, "Truncated binary DataArray");
+        uint64_t size = std::min<uint64_t>(readHeader(ctx, &bytes[0]),
+                                           bytes.size() - ctx.headerSize);
+        convertRaw(ctx, type, &bytes[ctx.headerSize], static_cast<size_t>(size), out, count);
+    } else if (strcmp(format, "appended") == 0) {
+        if (!ctx.appended) fail(ctx, "No AppendedData for appended DataArray");
+        const char* offset = e->Attribute("offset");
+        const unsigned char* p = ctx.appended + (offset ? strtoull(offset, NULL, 10) : 0);
+        if (p < ctx.appended || p + ctx.headerSize > ctx.appendedEnd) {
+            fail(ctx, "Appended DataArray offset out of range");
+        }
+        uint64_t size = std::min<uint64_t>(readHeader(ctx, p),
+                                           ctx.appendedEnd - p - ctx.headerSize);
+        convertRaw(ctx, type, p + ctx.headerSize, static_cast<size_t>(size), out, count);
+    } else {
+        fail(ctx, string("Unsupported DataArray format ") + format);
+    }
+}
+
+const XMLElement* findDataArray(const XMLElement* parent, const char* name) {
+    for (const XMLElement* e = parent->FirstChildElement("DataArray"); e;
+         e = e->NextSiblingElement("DataArray")) {
+        if (e->Attribute("Name", name)) return e;
+    }
+    return nullptr;
+}
+
+const char* find(const char* begin, const char* end, const char* what) {
+    size_t n = strlen(what);
+    const char* p = search(begin, end, what, what + n);
+    return p == end ? nullptr : p;
+}
+
+} // namespace
+
+void loadVTPIndexed(
+    const string& path,
+    vector<vec3>& points,
+    vector<vec3>& normals,
+    vector<unsigned int>& indices) {
+    MappedFile file;
+    if (!file.open(path)) throw runtime_error("Can't open " + path);
+
+    VTPContext ctx;
+    ctx.path = path;
+    ctx.appended = ctx.appendedEnd = nullptr;
+
+    // raw appended data is not XML, only the part before it is parsed
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    const char* appendedTag = find(begin, end, "<AppendedData");
+    string header;
+    if (appendedTag) {
+        const char* tagEnd = find(appendedTag, end, ">");
+        if (!tagEnd) fail(ctx, "Malformed AppendedData");
+        string tag(appendedTag, tagEnd);
+        if (tag.find("encoding=\"raw\"") == string::npos) {
+            fail(ctx, "Only raw encoded AppendedData is supported");
+        }
+        const char* marker = find(tagEnd, end, "_");
+        if (!marker) fail(ctx, "AppendedData without '_' marker");
+        ctx.appended = reinterpret_cast<const unsigned char*>(marker + 1);
+        ctx.appendedEnd = reinterpret_cast<const unsigned char*>(end);
+        header.assign(begin, appendedTag);
+        header += "</VTKFile>";
+    }
+
+    XMLDocument vtp;
+    XMLError res = appendedTag ? vtp.Parse(header.c_str(), header.size())
+                               : vtp.Parse(begin, file.size());
+    if (res != XML_SUCCESS) fail(ctx, "Invalid XML");
+
+    const XMLElement* root = vtp.FirstChildElement("VTKFile");
+    if (!root || !root->Attribute("type", "PolyData")) fail(ctx, "Not a PolyData file");
+    if (root->Attribute("byte_order", "BigEndian")) fail(ctx, "Big endian data is not supported");
+    if (root->Attribute("compressor")) fail(ctx, "Compressed data is not supported");
+    ctx.headerSize = root->Attribute("header_type", "UInt64") ? 8 : 4;
+
+    const XMLElement* polydata = root->FirstChildElement("PolyData");
+    const XMLElement* piece = polydata ? polydata->FirstChildElement("Piece") : nullptr;
+    if (!piece) fail(ctx, "No PolyData Piece");
+    const XMLElement* pointsElement = piece->FirstChildElement("Points");
+    const XMLElement* polys = piece->FirstChildElement("Polys");
+    if (!pointsElement || !pointsElement->FirstChildElement("DataArray") || !polys) {
+        fail(ctx, "No Points or Polys");
+    }
+
+    size_t numPoints = piece->UnsignedAttribute("NumberOfPoints");
+    size_t numPolys = piece->UnsignedAttribute("NumberOfPolys");
+
+    points.resize(numPoints);
+    readDataArray(ctx, pointsElement->FirstChildElement("DataArray"),
+                  numPoints ? &points[0].x : nullptr, 3 * numPoints);
+
+    // the array named by the Normals attribute, or the first one
+    normals.clear();
+    const XMLElement* pointData = piece->FirstChildElement("PointData");
+    if (pointData) {
+        const XMLElement* e = pointData->Attribute("Normals")
+            ? findDataArray(pointData, pointData->Attribute("Normals"))
+            : pointData->FirstChildElement("DataArray");
+        if (e && e->IntAttribute("NumberOfComponents") == 3) {
+            normals.resize(numPoints);
+            readDataArray(ctx, e, numPoints ? &normals[0].x : nullptr, 3 * numPoints);
+        }
+    }
+
+    const XMLElement* eoffsets = findDataArray(polys, "offsets");
+    const XMLElement* econnectivity = findDataArray(polys, "connectivity");
+    if (!eoffsets) fail(ctx, "Can't access offsets");
+    if (!econnectivity) fail(ctx, "Can't access connectivity");
+
+    vector<uint64_t> offsets(numPolys);
+    readDataArray(ctx, eoffsets, offsets.data(), numPolys);
+    size_t numConnectivity = numPolys ? static_cast<size_t>(offsets.back()) : 0;
+    vector<unsigned int> connectivity(numConnectivity);
+    readDataArray(ctx, econnectivity, connectivity.data(), numConnectivity);
+
+    // fan triangulation straight into the index buffer
+    indices.clear();
+    indices.reserve(3 * (numConnectivity - std::min(numConnectivity, 2 * numPolys)));
+    size_t start = 0;
+    for (size_t i = 0; i < numPolys; i++) {
+        size_t stop = static_cast<size_t>(offsets[i]);
+        if (stop < start || stop > numConnectivity) fail(ctx, "Invalid offsets");
+        for (size_t k = start; k < stop; k++) {
+            if (connectivity[k] >= numPoints) fail(ctx, "Point index out of range");
+        }
+        for (size_t k = start + 2; k < stop; k++) {
+            indices.push_back(connectivity[start]);
+            indices.push_back(connectivity[k - 1]);
+            indices.push_back(connectivity[k]);
+        }
+        start = stop;
+    }
+}
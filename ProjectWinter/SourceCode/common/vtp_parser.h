@@ -0,0 +1,22 @@
+#ifndef VTP_PARSER_H
+#define VTP_PARSER_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Loads the first Piece of a VTK PolyData (.vtp) file as an indexed mesh: one
+* vertex per point, point normals (if the PointData has any) and the Polys
+* fan triangulated into `indices`. DataArrays may be ascii, binary (base64)
+* or appended raw, uncompressed and little endian; Float32 arrays are copied
+* straight into `points`/`normals`. Throws runtime_error on failure.
+*/
+void loadVTPIndexed(
+    const std::string& path,
+    std::vector<glm::vec3>& points,
+    std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices
+);
+
+#endif
@@ -15,10 +15,15 @@
 
 // Shader loading utilities and other
 #include <common/shader.h>
+#include <common/shader_program.h>
+#include <common/gl_state.h>
 #include <common/util.h>
 #include <common/camera.h>
 #include <common/model.h>
+#include <common/geometry_pool.h>
+#include <common/uniform_buffer.h>
 #include <common/texture.h>
+#include <common/texture_cache.h>
 #include <common/light.h> 
 
 // My src files
@@ -41,6 +46,28 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 #define SHADOW_WIDTH 4096
 #define SHADOW_HEIGHT 4096
 
+// Screen space error (pixels) allowed when picking a level of detail, the
+// depth passes only need the silhouette so they take coarser levels
+#define LOD_PIXEL_ERROR 1.0f
+#define DEPTH_LOD_PIXEL_ERROR 4.0f
+
+// HOMEWORK 2: light2 also lights the scene (the LIGHT2 shader variant and
+// its shadow map), off since its contribution was commented out
+#define LIGHT2_LIGHTING 0
+
+// Uniform block binding points, the same in every program
+#define FRAME_BINDING              0
+#define LIGHT1_BINDING             1
+#define LIGHT2_BINDING             2
+#define MATERIAL_BINDING           3
+#define INSTANCE_MATERIALS_BINDING 4
+#define SHADOW_CASTER_BINDING      5
+
+// Slots of materialUBO
+#define SILVER_SLOT 0
+#define GOLD_SLOT   1
+#define RUBY_SLOT   2
+
 
 
 // Creating a structure to store the material parameters of an object
@@ -52,6 +79,35 @@ struct Material
 	float Ns;
 };
 
+// std140 layouts of the uniform blocks of the shaders
+struct FrameBlock
+{
+	mat4 V;
+	mat4 P;
+};
+
+struct LightBlock
+{
+	mat4 VP; // first, so ShadowCaster (Depth.vertexshader) can bind the same range
+	vec4 La;
+	vec4 Ld;
+	vec4 Ls;
+	vec3 lightPosition_worldspace;
+	float padding;
+};
+
+struct MaterialBlock
+{
+	vec4 Ka;
+	vec4 Kd;
+	vec4 Ks;
+	float Ns;
+	float padding[3];
+};
+
+static_assert(sizeof(FrameBlock) == 128 && sizeof(LightBlock) == 128 &&
+	sizeof(MaterialBlock) == 64, "std140 block size mismatch");
+
 // Global Variables
 GLFWwindow* window;
 Camera* camera;
@@ -61,36 +117,20 @@ Light* light2;
 int lightController = 1;         // 1 -> light & 2 -> light2
 int previousLightController = 0; // Print ONCE the selected light...
 
-GLuint ChampionOfLight;
-
-GLuint shaderProgram, depthProgram;
+// Variants of ShadowMapping (see the top of its fragment shader): material
+// only, terrain, and the unlit instanced light helpers
+ShaderProgram *shaderProgram, *terrainProgram, *unlitProgram;
+ShaderProgram* depthProgram;
 Drawable* sphere; // Light model helper
 GLuint depthFBO1, depthTexture1;
 GLuint depthFBO2, depthTexture2;
 
-// locations for shaderProgram
-GLuint viewMatrixLocation;
-GLuint projectionMatrixLocation;
-GLuint modelMatrixLocation;
-GLuint KaLocation, KdLocation, KsLocation, NsLocation;
-
-GLuint LaLocation1, LdLocation1, LsLocation1, light1PositionLocation;
-
-GLuint LaLocation2, LdLocation2, LsLocation2, light2PositionLocation;
-
-GLuint lightPowerLocation;
-GLuint diffuseColorSampler;
-GLuint specularColorSampler;
-GLuint useTextureLocation;
-
-GLuint depthMapSampler1;
-GLuint light1VPLocation;
-GLuint depthMapSampler2;
-GLuint light2VPLocation;
-
-// locations for depthProgram
-GLuint shadowViewProjectionLocation;
-GLuint shadowModelLocation;
+// Uniform blocks: camera matrices, one slot per light, one per material and
+// the materials[] table of instanced draws
+UniformBuffer* frameUBO;
+UniformBuffer* lightUBO;
+UniformBuffer* materialUBO;
+UniformBuffer* instanceMaterialUBO;
 
 // Terrain system
 TerrainRenderer* terrainSystem;
@@ -126,31 +166,32 @@ const Material ruby
 //		 it is recommended to create a function that will update all the parameters 
 //       of an object.
 // 
-// Creating a function to upload (make uniform) the light parameters to the shader program
-void uploadLight(const Light& light,
-	GLuint LaLocation, GLuint LdLocation, GLuint LsLocation,
-	GLuint lightPositionLocation)
+// Creating a function to upload the light parameters to its slot of lightUBO,
+// sent by uploadLights() only if they changed
+void uploadLight(Light& light, size_t slot)
 {
-	glUniform4f(LaLocation, light.La.r, light.La.g, light.La.b, light.La.a);
-	glUniform4f(LdLocation, light.Ld.r, light.Ld.g, light.Ld.b, light.Ld.a);
-	glUniform4f(LsLocation, light.Ls.r, light.Ls.g, light.Ls.b, light.Ls.a);
-	glUniform3f(
-		lightPositionLocation,
-		light.lightPosition_worldspace.x,
-		light.lightPosition_worldspace.y,
-		light.lightPosition_worldspace.z
-	);
+	LightBlock block = {
+		light.lightVP(),
+		light.La, light.Ld, light.Ls,
+		light.lightPosition_worldspace, 0.0f
+	};
+	lightUBO->update(slot, &block);
+}
+
+void uploadLights()
+{
+	uploadLight(*light1, 0);
+	uploadLight(*light2, 1);
+	lightUBO->flush();
 }
 
 
 
-// Creating a function to upload the material parameters of a model to the shader program
-void uploadMaterial(const Material& mtl)
+// Creating a function to convert the material parameters of a model to their
+// uniform block, the draws then pick the slot of materialUBO they need
+MaterialBlock materialBlock(const Material& mtl)
 {
-	glUniform4f(KaLocation, mtl.Ka.r, mtl.Ka.g, mtl.Ka.b, mtl.Ka.a);
-	glUniform4f(KdLocation, mtl.Kd.r, mtl.Kd.g, mtl.Kd.b, mtl.Kd.a);
-	glUniform4f(KsLocation, mtl.Ks.r, mtl.Ks.g, mtl.Ks.b, mtl.Ks.a);
-	glUniform1f(NsLocation, mtl.Ns);
+	return MaterialBlock{ mtl.Ka, mtl.Kd, mtl.Ks, mtl.Ns, { 0.0f, 0.0f, 0.0f } };
 }
 
 
@@ -158,68 +199,99 @@ void uploadMaterial(const Material& mtl)
 void createContext()
 {
 	// Create and compile our GLSL program from the shader
-	shaderProgram = loadShaders("shaders/ShadowMapping.vertexshader", "shaders/ShadowMapping.fragmentshader");
+	// All programs are submitted before any is checked, the driver
+	// compiles them while the uniform buffers are created below
+	ShaderBatch shaders;
+#if LIGHT2_LIGHTING
+	vector<string> lit = { "LIGHT2" };
+#else
+	vector<string> lit;
+#endif
+	vector<string> terrain = lit;
+	terrain.push_back("TERRAIN");
+	GLuint shaderID  = shaders.add("shaders/ShadowMapping.vertexshader", "shaders/ShadowMapping.fragmentshader", nullptr, lit);
+	GLuint terrainID = shaders.add("shaders/ShadowMapping.vertexshader", "shaders/ShadowMapping.fragmentshader", nullptr, terrain);
+	GLuint unlitID   = shaders.add("shaders/ShadowMapping.vertexshader", "shaders/ShadowMapping.fragmentshader", nullptr,
+		{ "UNLIT", "INSTANCED" });
 
 	// Task 3.1 
 	// Create and load the shader program for the depth buffer construction
 	// You need to load and use the Depth.vertexshader, Depth.fragmentshader
-	depthProgram = loadShaders("shaders/Depth.vertexshader", "shaders/Depth.fragmentshader");
+	GLuint depthID = shaders.add("shaders/Depth.vertexshader", "shaders/Depth.fragmentshader");
 
 	// NOTE: Don't forget to delete the shader programs on the free() function
 
 
 
-	// Get pointers to uniforms
-	// --- shaderProgram ---
-	projectionMatrixLocation = glGetUniformLocation(shaderProgram, "P");
-	viewMatrixLocation       = glGetUniformLocation(shaderProgram, "V");
-	modelMatrixLocation      = glGetUniformLocation(shaderProgram, "M");
-	// for phong lighting
-	KaLocation = glGetUniformLocation(shaderProgram, "mtl.Ka");
-	KdLocation = glGetUniformLocation(shaderProgram, "mtl.Kd");
-	KsLocation = glGetUniformLocation(shaderProgram, "mtl.Ks");
-	NsLocation = glGetUniformLocation(shaderProgram, "mtl.Ns");
-
-	LaLocation1 = glGetUniformLocation(shaderProgram, "light1.La");
-	LdLocation1 = glGetUniformLocation(shaderProgram, "light1.Ld");
-	LsLocation1 = glGetUniformLocation(shaderProgram, "light1.Ls");
-	light1PositionLocation = glGetUniformLocation(shaderProgram, "light1.lightPosition_worldspace");
+	// Uniform blocks
+	// Lights, materials and the camera matrices live in uniform buffers shared
+	// by all programs, a draw only selects the slots it needs
+	frameUBO = new UniformBuffer(sizeof(FrameBlock));
+	lightUBO = new UniformBuffer(sizeof(LightBlock), 2);
 
-	LaLocation2 = glGetUniformLocation(shaderProgram, "light2.La");
-	LdLocation2 = glGetUniformLocation(shaderProgram, "light2.Ld");
-	LsLocation2 = glGetUniformLocation(shaderProgram, "light2.Ls");
-	light2PositionLocation = glGetUniformLocation(shaderProgram, "light2.lightPosition_worldspace");
+	MaterialBlock materials[8] = { materialBlock(polishedSilver), materialBlock(gold), materialBlock(ruby) };
+	materialUBO = new UniformBuffer(sizeof(MaterialBlock), 3);
+	materialUBO->update(SILVER_SLOT, &materials[SILVER_SLOT]);
+	materialUBO->update(GOLD_SLOT,   &materials[GOLD_SLOT]);
+	materialUBO->update(RUBY_SLOT,   &materials[RUBY_SLOT]);
+	materialUBO->flush();
 
-	ChampionOfLight = glGetUniformLocation(shaderProgram, "ChampionOfLight");
+	// Instanced draws index the whole materials[8] table: gold, ruby
+	MaterialBlock instanceMaterials[8] = { materials[GOLD_SLOT], materials[RUBY_SLOT] };
+	instanceMaterialUBO = new UniformBuffer(sizeof(instanceMaterials));
+	instanceMaterialUBO->update(0, instanceMaterials);
+	instanceMaterialUBO->flush();
 
-	diffuseColorSampler  = glGetUniformLocation(shaderProgram, "diffuseColorSampler");
-	specularColorSampler = glGetUniformLocation(shaderProgram, "specularColorSampler");
+	frameUBO->bind(FRAME_BINDING);
+	lightUBO->bind(LIGHT1_BINDING, 0);
+	lightUBO->bind(LIGHT2_BINDING, 1);
+	instanceMaterialUBO->bind(INSTANCE_MATERIALS_BINDING);
 
-	// Task 1.4
-	useTextureLocation = glGetUniformLocation(shaderProgram, "useTexture");
+	// First use of the programs
+	shaders.finish();
+	printProgramCacheReport();
 
-	// locations for shadow rendering
-	depthMapSampler1 = glGetUniformLocation(shaderProgram, "shadowMapSampler1");
-	light1VPLocation = glGetUniformLocation(shaderProgram, "light1VP");
+	// Uniforms are set by name from here on (see ShaderProgram)
+	shaderProgram  = new ShaderProgram(shaderID);
+	terrainProgram = new ShaderProgram(terrainID);
+	unlitProgram   = new ShaderProgram(unlitID);
+	depthProgram   = new ShaderProgram(depthID);
 
-	// ===< HOMEWORK 2 >=== //
-	depthMapSampler2 = glGetUniformLocation(shaderProgram, "shadowMapSampler2");
-	light2VPLocation = glGetUniformLocation(shaderProgram, "light2VP");
+	ShaderProgram* programs[] = { shaderProgram, terrainProgram, unlitProgram, depthProgram };
+	for (ShaderProgram* program : programs)
+	{
+		bindUniformBlock(program->id(), "Frame",             FRAME_BINDING);
+		bindUniformBlock(program->id(), "Light1",            LIGHT1_BINDING);
+		bindUniformBlock(program->id(), "Light2",            LIGHT2_BINDING);
+		bindUniformBlock(program->id(), "MaterialBlock",     MATERIAL_BINDING);
+		bindUniformBlock(program->id(), "InstanceMaterials", INSTANCE_MATERIALS_BINDING);
+		bindUniformBlock(program->id(), "ShadowCaster",      SHADOW_CASTER_BINDING);
+
+		// Task 4.1 the shadow maps are always bound to units 23 and 24
+		program->use();
+		program->set("shadowMapSampler1", 23);
+		program->set("shadowMapSampler2", 24);
+	}
 
-	// --- depthProgram ---
-	shadowViewProjectionLocation = glGetUniformLocation(depthProgram, "VP");
-	shadowModelLocation          = glGetUniformLocation(depthProgram, "M");
 
 
+	// Nothing reads the geometry back after upload, keep only what draw() needs
+	setDefaultRetention(Retention::KeepNone);
+	// Packed normals and half UVs, the terrain also quantizes its positions
+	setDefaultVertexLayout(VertexLayout::Packed);
 
 	// Initialize the terrain system
-	terrainSystem = new TerrainRenderer(shaderProgram);
+	terrainSystem = new TerrainRenderer(terrainProgram);
+	printTextureCacheReport();
 
 	// Loading a model
 
 	// Task 1.2 Load earth.obj using drawable 
 	sphere = new Drawable("assets/earth.obj");
 
+	Drawable::printMemoryReport();
+	GeometryPool::printReport();
+
 
 
 	// ---------------------------------------------------------------------------- //
@@ -229,13 +301,13 @@ void createContext()
 	glGenFramebuffers(1, &depthFBO1);
 	// Binding the framebuffer, all changes bellow will affect the binded framebuffer
 	// **Don't forget to bind the default framebuffer at the end of initialization
-	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO1);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, depthFBO1);
 
 
 
 	// We need a texture to store the depth image
 	glGenTextures(1, &depthTexture1);
-	glBindTexture(GL_TEXTURE_2D, depthTexture1);
+	GLState::bindTexture(GL_TEXTURE_2D, depthTexture1);
 	// Telling opengl the required information about the texture
 	glTexImage2D(
 		GL_TEXTURE_2D,
@@ -274,10 +346,10 @@ void createContext()
 
 	// Framebuffer for light2
 	glGenFramebuffers(1, &depthFBO2);
-	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO2);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, depthFBO2);
 
 	glGenTextures(1, &depthTexture2);
-	glBindTexture(GL_TEXTURE_2D, depthTexture2);
+	GLState::bindTexture(GL_TEXTURE_2D, depthTexture2);
 	glTexImage2D(
 		GL_TEXTURE_2D,
 		0,
@@ -312,7 +384,7 @@ void createContext()
 	}
 
 	// Binding the default framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
@@ -320,17 +392,31 @@ void createContext()
 void free()
 {
 	// Delete Shader Programs
-	glDeleteProgram(shaderProgram);
-	glDeleteProgram(depthProgram);
+	delete shaderProgram;
+	delete terrainProgram;
+	delete unlitProgram;
+	delete depthProgram;
 
 	terrainSystem->~TerrainRenderer();
+	delete sphere;
+
+	delete frameUBO;
+	delete lightUBO;
+	delete materialUBO;
+	delete instanceMaterialUBO;
+
+	// after every pooled Drawable is gone
+	GeometryPool::releaseAll();
+
+	GLState::printReport();
 
 	glfwTerminate();
 }
 
 
 
-void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo)
+// `lightSlot` is the light's slot of lightUBO, see uploadLights()
+void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo, size_t lightSlot)
 {
 	// Task 3.3
 
@@ -338,17 +424,16 @@ void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo)
 	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
 	// Binding the depth framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, fbo);
 
 	// Cleaning the framebuffer depth information (stored from the last render)
 	glClear(GL_DEPTH_BUFFER_BIT);
 
 	// Selecting the new shader program that will output the depth component
-	glUseProgram(depthProgram);
+	depthProgram->use();
 
-	// sending the view and projection matrix to the shader
-	mat4 view_projection = projectionMatrix * viewMatrix;
-	glUniformMatrix4fv(shadowViewProjectionLocation, 1, GL_FALSE, &view_projection[0][0]);
+	// selecting the view-projection matrix of the light (the start of its block)
+	lightUBO->bind(SHADOW_CASTER_BINDING, lightSlot);
 
 
 
@@ -356,20 +441,25 @@ void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo)
 
 	// For sphere
 	mat4 sphereModelMatrix = translate(mat4(), vec3(0.0f, 7.0f, 0.0f)) * scale(mat4(), vec3(0.5f));
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &sphereModelMatrix[0][0]);
+	depthProgram->set("M", sphereModelMatrix);
+	depthProgram->set("dequantization", sphere->dequantization);
 	sphere->bind();
-	sphere->draw();
+	sphere->drawLod(sphere->selectLod(sphereModelMatrix, viewMatrix, projectionMatrix,
+		SHADOW_HEIGHT, DEPTH_LOD_PIXEL_ERROR));
 
 	// Terrain
+	Drawable* terrainMesh = terrainSystem->getTerrainMesh();
 	mat4 terrainModelMatrix = terrainSystem->getTerrainModelMatrix();
-	glUniformMatrix4fv(shadowModelLocation, 1, GL_FALSE, &terrainModelMatrix[0][0]);
-	terrainSystem->getTerrainMesh()->bind();
-	terrainSystem->getTerrainMesh()->draw();
+	depthProgram->set("M", terrainModelMatrix);
+	depthProgram->set("dequantization", terrainMesh->dequantization);
+	terrainMesh->bind();
+	terrainMesh->drawLod(terrainMesh->selectLod(terrainModelMatrix, viewMatrix, projectionMatrix,
+		SHADOW_HEIGHT, DEPTH_LOD_PIXEL_ERROR));
 
 
 
 	// binding the default framebuffer again
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
@@ -377,46 +467,25 @@ void depth_pass(mat4 viewMatrix, mat4 projectionMatrix, GLuint fbo)
 void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix)
 {
 	// Step 1: Binding a frame buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 	glViewport(0, 0, W_WIDTH, W_HEIGHT);
 
 	// Step 2: Clearing color and depth info
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// Step 3: Selecting shader program
-	glUseProgram(shaderProgram);
-
-	// Making view and projection matrices uniform to the shader program
-	glUniformMatrix4fv(viewMatrixLocation,       1, GL_FALSE, &viewMatrix[0][0]);
-	glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
+	// Uploading the view and projection matrices once for the frame
+	FrameBlock frame = { viewMatrix, projectionMatrix };
+	frameUBO->update(0, &frame);
+	frameUBO->flush();
 
-	glUniform1i(ChampionOfLight, false); // Κανονικά αντικείμενα - Κάνε υπολογισμούς Phong!
 
 
-
-	// uploading the light parameters to the shader program
-	uploadLight(*light1, LaLocation1, LdLocation1, LsLocation1, light1PositionLocation);
+	// The light parameters and View-Projection matrices are already in lightUBO
 
 	// Task 4.1 Display shadows on the plane
-	// Sending the shadow texture to the shaderProgram
-	glActiveTexture(GL_TEXTURE23);
-	glBindTexture(GL_TEXTURE_2D, depthTexture1);
-	glUniform1i(depthMapSampler1, 23);
-
-	// Sending the light View-Projection matrix to the shader program
-	mat4 light1VP = light1->lightVP();
-	glUniformMatrix4fv(light1VPLocation, 1, GL_FALSE, &light1VP[0][0]);
-
-
-
-	uploadLight(*light2, LaLocation2, LdLocation2, LsLocation2, light2PositionLocation);
-
-	glActiveTexture(GL_TEXTURE24);
-	glBindTexture(GL_TEXTURE_2D, depthTexture2);
-	glUniform1i(depthMapSampler2, 24);
-
-	mat4 light2VP = light2->lightVP();
-	glUniformMatrix4fv(light2VPLocation, 1, GL_FALSE, &light2VP[0][0]);
+	// Binding the shadow textures to the units the samplers read (see createContext)
+	GLState::bindTexture(GL_TEXTURE23, GL_TEXTURE_2D, depthTexture1);
+	GLState::bindTexture(GL_TEXTURE24, GL_TEXTURE_2D, depthTexture2);
 
 
 
@@ -424,52 +493,44 @@ void lighting_pass(mat4 viewMatrix, mat4 projectionMatrix)
 	// --------------------- Drawing scene objects --------------------- //	
 	// ----------------------------------------------------------------- //
 
-	// Draw terrain!
+	// Draw terrain! (selects terrainProgram)
 	float currentTime = (float) glfwGetTime() / 20.0f;
-	terrainSystem->draw(viewMatrix, projectionMatrix, currentTime);
+	terrainSystem->draw(viewMatrix, projectionMatrix, currentTime, W_HEIGHT, LOD_PIXEL_ERROR);
 
 
 
-	// Remove the texture from model2 and use material instead
-	// ** Use bool variable to tell the shader not to use a texture
-	// ** Look at if statement in the fragment shader
-	uploadMaterial(polishedSilver);
-	glUniform1i(useTextureLocation, 0); // Tell shader not to use texture!
+	// Step 3: Selecting shader program, the material only variant
+	shaderProgram->use();
+	materialUBO->bind(MATERIAL_BINDING, SILVER_SLOT);
 
 	// Task 1.2 - Draw the sphere on the scene
 	// Use a scaling of 0.5 across all dimensions and translate it to (-3, 1, -3)
 	mat4 sphereModelMatrix = translate(mat4(), vec3(0.0f, 7.0f, 0.0f)) * scale(mat4(), vec3(0.5f));
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &sphereModelMatrix[0][0]);
+	shaderProgram->set("M", sphereModelMatrix);
 
 	sphere->bind();
-	sphere->draw();
+	sphere->drawLod(sphere->selectLod(sphereModelMatrix, viewMatrix, projectionMatrix,
+		W_HEIGHT, LOD_PIXEL_ERROR));
 
 
 
 	// Light sphere model (visualization helper)
-	glUniform1i(ChampionOfLight, 1); // Render with only ambient component!
+	unlitProgram->use(); // Render with only ambient component!
 
 	mat4 temp = scale(mat4(), vec3(0.1f));
 
-	// Light sphere 1
-	mat4 light1SphereModel = translate(mat4(), light1->lightPosition_worldspace) * temp;
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &light1SphereModel[0][0]);
-
-	uploadMaterial(gold);
-	glUniform1i(useTextureLocation, 0);
-
-	sphere->bind(); sphere->draw();
-
-	// Light sphere 2
-	mat4 light2SphereModel = translate(mat4(), light2->lightPosition_worldspace) * temp;
-	glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &light2SphereModel[0][0]);
-
-	uploadMaterial(ruby);
-	glUniform1i(useTextureLocation, 0);
-
-	sphere->bind(); sphere->draw();
+	// Both light spheres in one instanced draw, gold and ruby (see createContext)
+	mat4 lightSphereModels[2] = {
+		translate(mat4(), light1->lightPosition_worldspace) * temp,
+		translate(mat4(), light2->lightPosition_worldspace) * temp
+	};
+	GLuint lightSphereMaterials[2] = { 0, 1 };
+	size_t lightSphereLod = std::min(
+		sphere->selectLod(lightSphereModels[0], viewMatrix, projectionMatrix, W_HEIGHT, LOD_PIXEL_ERROR),
+		sphere->selectLod(lightSphereModels[1], viewMatrix, projectionMatrix, W_HEIGHT, LOD_PIXEL_ERROR));
 
-	glUniform1d(ChampionOfLight, 0);
+	sphere->bind();
+	sphere->drawInstanced(lightSphereModels, lightSphereMaterials, 2, lightSphereLod);
 }
 
 
@@ -479,12 +540,16 @@ void mainLoop()
 	light1->update();
 	mat4 light1_proj = light1->projectionMatrix;
 	mat4 light1_view = light1->viewMatrix;
-	depth_pass(light1_view, light1_proj, depthFBO1); // Create the depth buffer
 
 	light2->update();
+
+	uploadLights();
+	depth_pass(light1_view, light1_proj, depthFBO1, 0); // Create the depth buffer
+#if LIGHT2_LIGHTING
 	mat4 light2_proj = light2->projectionMatrix;
 	mat4 light2_view = light2->viewMatrix;
-	depth_pass(light2_view, light2_proj, depthFBO2);
+	depth_pass(light2_view, light2_proj, depthFBO2, 1);
+#endif
 
 	do
 	{
@@ -505,11 +570,14 @@ void mainLoop()
 
 		mat4 light1_proj = light1->projectionMatrix;
 		mat4 light1_view = light1->viewMatrix;
-		depth_pass(light1_view, light1_proj, depthFBO1); // Create the depth buffer
 
+		uploadLights(); // only sent if a light moved
+		depth_pass(light1_view, light1_proj, depthFBO1, 0); // Create the depth buffer
+#if LIGHT2_LIGHTING
 		mat4 light2_proj = light2->projectionMatrix;
 		mat4 light2_view = light2->viewMatrix;
-		depth_pass(light2_view, light2_proj, depthFBO2);
+		depth_pass(light2_view, light2_proj, depthFBO2, 1);
+#endif
 
 		// Getting camera information
 		camera->update();
@@ -522,6 +590,9 @@ void mainLoop()
 
 
 
+		ShaderProgram::endFrame();
+		GLState::endFrame();
+
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
@@ -542,6 +613,17 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 		if (polygonMode[0] == GL_LINE) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		if (polygonMode[0] == GL_FILL) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	}
+
+	// Uniform uploads and binds of the last frame, redundant ones are skipped
+	if (key == GLFW_KEY_U && action == GLFW_PRESS)
+	{
+		ShaderProgram::UploadStats stats = ShaderProgram::lastFrameStats();
+		cout << "Uniform uploads: " << stats.issued << " issued, "
+			<< stats.skipped << " skipped" << endl;
+		GLState::Stats binds = GLState::lastFrameStats();
+		cout << "GL binds: " << binds.issued << " issued, "
+			<< binds.skipped << " skipped" << endl;
+	}
 }
 
 
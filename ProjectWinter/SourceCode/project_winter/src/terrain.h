@@ -6,42 +6,44 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
+#include <string>
 #include <common/model.h>
+#include <common/shader_program.h>
 
 using namespace glm;
 
 class TerrainRenderer
 {
 public:
-    // Constructor: Loads shaders and textures
-    TerrainRenderer(GLuint shaderProgram);
+    // The tiled materials, the layers of one texture array in the order the
+    // shader reads them (*_LAYER): rock, grass, dirt, sand
+    static const std::vector<std::string> DEFAULT_MATERIALS;
+
+    // Constructor: Loads shaders and textures, `materials` are same sized .bmp
+    // (or their cooked .dds, see tools/texture_cooker)
+    TerrainRenderer(ShaderProgram* shaderProgram,
+                    const std::vector<std::string>& materials = DEFAULT_MATERIALS);
 
     // Destructor: Cleans up memory
     ~TerrainRenderer();
 
-    // The main function to render the terrain
-    void draw(const mat4& viewMatrix, const mat4& projectionMatrix, float time);
+    // The main function to render the terrain, at the level of detail whose
+    // error stays under lodPixelError pixels on a viewport viewportHeight high
+    void draw(const mat4& viewMatrix, const mat4& projectionMatrix, float time,
+              float viewportHeight, float lodPixelError = 1.0f);
 
 	Drawable* getTerrainMesh() { return terrain; }
 
     mat4 getTerrainModelMatrix() { return scale(mat4(), vec3(10.0f)); }
 
 private:
-    // Shader Program
-    GLuint shaderProgram;
-
-	GLuint isTerrain; // ShadowMapping bs...
-
-    // Uniform Locations
-    GLuint vpLocation, mLocation, timeLocation;
-
-    // Texture Sampler Locations
-    GLuint textureSamplerWorld, textureSamplerSlope, textureSamplerSoil, textureSamplerPeaks, textureSamplerLake, textureSamplerRivers;
-    GLuint textureSamplerRock, textureSamplerGrass, textureSamplerDirt, textureSamplerSand, textureSamplerWater, textureSamplerDisplacement, textureSamplerRiversDirection;
+    // Shader Program, the TERRAIN variant of ShadowMapping (not owned)
+    ShaderProgram* shaderProgram;
 
     // Actual Texture IDs
-    GLuint textureWorld, textureSlope, textureSoil, texturePeaks, textureLake, textureRivers;
-    GLuint textureRock, textureGrass, textureDirt, textureSand, textureWater, textureRiversDirection, textureDisplacement;
+    GLuint textureWorld, textureMasks; // masks: slope, soil, lake, rivers
+    GLuint textureMaterials; // GL_TEXTURE_2D_ARRAY
+    GLuint textureWater, textureRiversDirection, textureDisplacement;
 
     // The 3D Mesh
     Drawable* terrain;
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <common/mesh_indexer.h>
+
+using namespace std;
+using namespace glm;
+
+/**
+* Compares indexVertices() (serial and sharded) against the previous std::map
+* based indexVBO on synthetic grid meshes (6 corners per quad, each grid
+* vertex shared by up to 6 corners), then indexTriples() (serial and sharded)
+* on the OBJ index triples of the same grids. Usage: bench_indexvbo
+* [max corners], default 10M.
+*/
+
+struct PackedVertex {
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+    bool operator<(const PackedVertex that) const {
+        return memcmp((void*) this, (void*) &that, sizeof(PackedVertex)) > 0;
+    };
+};
+
+static void indexVBOMap(
+    const vector<vec3>& in_vertices,
+    const vector<vec2>& in_uvs,
+    const vector<vec3>& in_normals,
+    vector<unsigned int>& out_indices,
+    vector<vec3>& out_vertices,
+    vector<vec2>& out_uvs,
+    vector<vec3>& out_normals) {
+    map<PackedVertex, unsigned int> vertexToOutIndex;
+    for (size_t i = 0; i < in_vertices.size(); i++) {
+        PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
+        map<PackedVertex, unsigned int>::iterator it = vertexToOutIndex.find(packed);
+        if (it != vertexToOutIndex.end()) {
+            out_indices.push_back(it->second);
+        } else {
+            out_vertices.push_back(in_vertices[i]);
+            out_uvs.push_back(in_uvs[i]);
+            out_normals.push_back(in_normals[i]);
+            unsigned int newindex = (unsigned int) out_vertices.size() - 1;
+            out_indices.push_back(newindex);
+            vertexToOutIndex[packed] = newindex;
+        }
+    }
+}
+
+static void makeGrid(size_t corners, vector<vec3>& v, vector<vec2>& uv, vector<vec3>& n) {
+    size_t side = 1;
+    while (6 * side * side < corners) side++;
+    v.clear(); uv.clear(); n.clear();
+    for (size_t q = 0; v.size() < corners; q++) {
+        size_t x = q % side, z = q / side;
+        const size_t cx[6] = {0, 1, 1, 0, 1, 0}, cz[6] = {0, 0, 1, 0, 1, 1};
+        for (int c = 0; c < 6 && v.size() < corners; c++) {
+            float px = float(x + cx[c]), pz = float(z + cz[c]);
+            float h = sinf(px * 0.1f) * cosf(pz * 0.1f);
+            v.push_back(vec3(px, h, pz));
+            uv.push_back(vec2(px / side, pz / side));
+            n.push_back(normalize(vec3(-h, 1.0f, h)));
+        }
+    }
+}
+
+// (vertex, normal, texcoord) triples of the grid, normals are per vertex and
+// the texcoords have a seam every 16 columns like an unwrapped scan
+static void makeGridTriples(size_t corners, vector<int>& triples) {
+    size_t side = 1;
+    while (6 * side * side < corners) side++;
+    triples.clear();
+    for (size_t q = 0; triples.size() < 3 * corners; q++) {
+        size_t x = q % side, z = q / side;
+        const size_t cx[6] = {0, 1, 1, 0, 1, 0}, cz[6] = {0, 0, 1, 0, 1, 1};
+        for (int c = 0; c < 6 && triples.size() < 3 * corners; c++) {
+            int vertex = int((z + cz[c]) * (side + 1) + x + cx[c]);
+            bool seam = cx[c] == 1 && (x + 1) % 16 == 0;
+            triples.push_back(vertex);
+            triples.push_back(vertex);
+            triples.push_back(seam ? -1 : vertex);
+        }
+    }
+}
+
+template<typename F>
+static double timeMs(F f) {
+    auto start = chrono::high_resolution_clock::now();
+    f();
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t maxCorners = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    cout << setw(10) << "corners" << setw(10) << "unique"
+        << setw(12) << "map (ms)" << setw(12) << "hash (ms)"
+        << setw(14) << "sharded (ms)" << setw(10) << "speedup" << endl;
+    for (size_t corners = 10000; corners <= maxCorners; corners *= 10) {
+        vector<vec3> v, n;
+        vector<vec2> uv;
+        makeGrid(corners, v, uv, n);
+
+        vector<unsigned int> mapIndices, hashIndices;
+        vector<vec3> mapV, mapN, hashV, hashN;
+        vector<vec2> mapUV, hashUV;
+        double mapMs = timeMs([&] {
+            indexVBOMap(v, uv, n, mapIndices, mapV, mapUV, mapN);
+        });
+        setParallelIndexingThreshold(numeric_limits<size_t>::max());
+        double hashMs = timeMs([&] {
+            indexVertices(v.data(), uv.data(), n.data(), v.size(),
+                hashIndices, hashV, hashUV, hashN);
+        });
+
+        vector<unsigned int> shardIndices;
+        vector<vec3> shardV, shardN;
+        vector<vec2> shardUV;
+        setParallelIndexingThreshold(0);
+        double shardMs = timeMs([&] {
+            indexVertices(v.data(), uv.data(), n.data(), v.size(),
+                shardIndices, shardV, shardUV, shardN);
+        });
+
+        if (mapIndices != hashIndices || mapV != hashV || mapUV != hashUV || mapN != hashN ||
+            shardIndices != hashIndices || shardV != hashV ||
+            shardUV != hashUV || shardN != hashN) {
+            cout << "Output mismatch for " << corners << " corners" << endl;
+            return 1;
+        }
+        cout << setw(10) << corners << setw(10) << hashV.size()
+            << fixed << setprecision(1)
+            << setw(12) << mapMs << setw(12) << hashMs << setw(14) << shardMs
+            << setw(9) << mapMs / std::min(hashMs, shardMs) << "x" << endl;
+    }
+
+    cout << endl << setw(10) << "triples" << setw(10) << "unique"
+        << setw(12) << "serial (ms)" << setw(14) << "sharded (ms)" << setw(10) << "speedup" << endl;
+    for (size_t corners = 10000; corners <= maxCorners; corners *= 10) {
+        vector<int> triples;
+        makeGridTriples(corners, triples);
+
+        // reference: one IndexTripleMap insert per corner
+        vector<unsigned int> mapIndices, mapFirsts;
+        IndexTripleMap map;
+        for (size_t i = 0; i < corners; i++) {
+            bool inserted;
+            mapIndices.push_back(map.insert(triples[3 * i], triples[3 * i + 1], triples[3 * i + 2], inserted));
+            if (inserted) mapFirsts.push_back((unsigned int) i);
+        }
+
+        vector<unsigned int> serialIndices, serialFirsts, shardIndices, shardFirsts;
+        setParallelIndexingThreshold(numeric_limits<size_t>::max());
+        double serialMs = timeMs([&] {
+            indexTriples(triples.data(), corners, serialIndices, serialFirsts);
+        });
+        setParallelIndexingThreshold(0);
+        double shardMs = timeMs([&] {
+            indexTriples(triples.data(), corners, shardIndices, shardFirsts);
+        });
+
+        if (serialIndices != mapIndices || serialFirsts != mapFirsts ||
+            shardIndices != serialIndices || shardFirsts != serialFirsts) {
+            cout << "Output mismatch for " << corners << " triples" << endl;
+            return 1;
+        }
+        cout << setw(10) << corners << setw(10) << serialFirsts.size()
+            << fixed << setprecision(1)
+            << setw(12) << serialMs << setw(14) << shardMs
+            << setw(9) << serialMs / shardMs << "x" << endl;
+    }
+    return 0;
+}
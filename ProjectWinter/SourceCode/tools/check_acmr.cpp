@@ -0,0 +1,56 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <common/mesh_optimizer.h>
+
+using namespace std;
+
+/**
+* Checks computeACMR() against hand counted FIFO cache misses, so the
+* "ACMR before -> after" of optimizeMesh() can be trusted. Returns non-zero
+* on a mismatch (ctest: check_acmr).
+*/
+
+static int failures = 0;
+
+static void check(const char* name, const vector<unsigned int>& indices, size_t vertexCount,
+                  unsigned int cacheSize, float expected) {
+    float acmr = computeACMR(indices, vertexCount, cacheSize);
+    bool ok = fabs(acmr - expected) < 1e-5f;
+    if (!ok) failures++;
+    cout << (ok ? "ok   " : "FAIL ") << name << ": ACMR " << acmr << ", expected " << expected << endl;
+}
+
+int main() {
+    // a vertex read again right away is a hit, even with one entry
+    check("one entry, same vertex", {0, 0, 0}, 1, 1, 1.0f);
+    check("one entry, alternating", {0, 1, 0}, 2, 1, 3.0f);
+
+    // the same triangle twice: 3 misses, then 3 hits
+    check("repeated triangle", {0, 1, 2, 0, 1, 2}, 3, 3, 1.5f);
+
+    // 16 distinct vertices fill a 16 entry cache exactly, vertex 0 is the
+    // oldest entry but still cached; with 15 entries it was evicted
+    vector<unsigned int> full = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1};
+    check("16 vertices, 16 entries", full, 16, 16, 16.0f / 6.0f);
+    check("16 vertices, 15 entries", full, 16, 15, 18.0f / 6.0f);
+
+    // optimizing a grid must not make it worse
+    vector<unsigned int> grid;
+    const unsigned int side = 32;
+    for (unsigned int z = 0; z + 1 < side; z++) {
+        for (unsigned int x = 0; x + 1 < side; x++) {
+            unsigned int v = z * side + x;
+            unsigned int quad[6] = {v, v + 1, v + side, v + 1, v + side + 1, v + side};
+            grid.insert(grid.end(), quad, quad + 6);
+        }
+    }
+    float before = computeACMR(grid, side * side);
+    optimizeVertexCache(grid, side * side);
+    float after = computeACMR(grid, side * side);
+    bool ok = after <= before;
+    if (!ok) failures++;
+    cout << (ok ? "ok   " : "FAIL ") << "grid: ACMR " << before << " -> " << after << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <SOIL.h>
+#include <common/block_compress.h>
+#include <common/parallel.h>
+
+using namespace std;
+
+/**
+* Cooks images (BMP/PNG/JPG/TGA, anything SOIL reads) into block compressed
+* .dds files with a full mip chain, for loadDDS(). Usage:
+*
+*   texture_cooker <bc1|bc3|bc4|bc5> <output.dds> <input> [input2]
+*
+* bc1/bc3 are for colour (bc3 keeps alpha), bc4 stores the red channel and
+* bc5 red and green, or the red channels of input and input2. Rows are stored
+* bottom up like the BMPs loadBMP() uploads, so cooked textures are drop-in
+* replacements for them.
+*/
+
+#define FOURCC(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+struct RGBAImage {
+    int width, height;
+    vector<unsigned char> pixels;
+};
+
+template<typename F>
+static double timeMs(F f) {
+    auto start = chrono::high_resolution_clock::now();
+    f();
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+static RGBAImage loadImage(const string& path) {
+    RGBAImage image;
+    int channels;
+    unsigned char* data = SOIL_load_image(path.c_str(), &image.width, &image.height,
+                                          &channels, SOIL_LOAD_RGBA);
+    if (!data) {
+        throw runtime_error("Image could not be loaded: " + path + " (" + SOIL_last_result() + ")");
+    }
+    // SOIL returns the top row first
+    size_t row = (size_t) image.width * 4;
+    image.pixels.resize(row * image.height);
+    for (int y = 0; y < image.height; y++) {
+        memcpy(&image.pixels[row * y], data + row * (image.height - 1 - y), row);
+    }
+    SOIL_free_image_data(data);
+    return image;
+}
+
+static void writeDDS(const string& path, BlockFormat format, int width, int height,
+                     const vector<vector<unsigned char>>& levels) {
+    uint32_t header[31];
+    memset(header, 0, sizeof(header));
+    header[0] = 124;                                   // dwSize
+    header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // CAPS HEIGHT WIDTH PIXELFORMAT MIPMAPCOUNT LINEARSIZE
+    header[2] = height;
+    header[3] = width;
+    header[4] = (uint32_t) levels[0].size();           // dwPitchOrLinearSize
+    header[6] = (uint32_t) levels.size();              // dwMipMapCount
+    header[18] = 32;                                   // ddspf.dwSize
+    header[19] = 0x4;                                  // DDPF_FOURCC
+    switch (format) {
+    case BlockFormat::BC1: header[20] = FOURCC('D', 'X', 'T', '1'); break;
+    case BlockFormat::BC3: header[20] = FOURCC('D', 'X', 'T', '5'); break;
+    case BlockFormat::BC4: header[20] = FOURCC('A', 'T', 'I', '1'); break;
+    case BlockFormat::BC5: header[20] = FOURCC('A', 'T', 'I', '2'); break;
+    }
+    header[26] = 0x1000 | 0x400000 | 0x8;              // TEXTURE MIPMAP COMPLEX
+
+    ofstream out(path.c_str(), ios::binary);
+    if (!out) throw runtime_error("Could not write " + path);
+    out.write("DDS ", 4);
+    out.write((const char*) header, sizeof(header));
+    for (const vector<unsigned char>& level : levels) {
+        out.write((const char*) level.data(), level.size());
+    }
+    if (!out) throw runtime_error("Could not write " + path);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4 || argc > 5) {
+        cout << "Usage: texture_cooker <bc1|bc3|bc4|bc5> <output.dds> <input> [input2]" << endl;
+        return 1;
+    }
+    string name = argv[1];
+    BlockFormat format;
+    if (name == "bc1") format = BlockFormat::BC1;
+    else if (name == "bc3") format = BlockFormat::BC3;
+    else if (name == "bc4") format = BlockFormat::BC4;
+    else if (name == "bc5") format = BlockFormat::BC5;
+    else {
+        cout << "Unknown format " << name << endl;
+        return 1;
+    }
+
+    try {
+        RGBAImage image;
+        double loadTime = timeMs([&] {
+            image = loadImage(argv[3]);
+            // bc5 of two images: the red of each
+            if (argc == 5) {
+                RGBAImage second = loadImage(argv[4]);
+                if (second.width != image.width || second.height != image.height) {
+                    throw runtime_error("Inputs must be of the same size");
+                }
+                for (size_t i = 0; i < image.pixels.size(); i += 4) {
+                    image.pixels[i + 1] = second.pixels[i];
+                }
+            }
+        });
+
+        // Mip chain down to 1x1, each level compressed from the one above it
+        vector<vector<unsigned char>> levels;
+        size_t compressedBytes = 0;
+        double cookTime = timeMs([&] {
+            vector<unsigned char> level = image.pixels;
+            int width = image.width, height = image.height;
+            while (true) {
+                levels.emplace_back(compressedSize(format, width, height));
+                compressImage(format, level.data(), width, height, levels.back().data());
+                compressedBytes += levels.back().size();
+                if (width == 1 && height == 1) break;
+                level = downsample(level.data(), width, height);
+                width = max(1, width / 2);
+                height = max(1, height / 2);
+            }
+        });
+        writeDDS(argv[2], format, image.width, image.height, levels);
+
+        // What glTexImage2D(GL_RGB) + glGenerateMipmap would take
+        size_t rawBytes = (size_t) image.width * image.height * 3 * 4 / 3;
+        cout << argv[2] << ": " << image.width << "x" << image.height << " " << name << ", "
+             << levels.size() << " levels, " << compressedBytes << " bytes ("
+             << (double) rawBytes / compressedBytes << "x smaller than RGB8), load "
+             << loadTime << " ms, compress " << cookTime << " ms (" << workerCount()
+             << " threads)" << endl;
+    } catch (const exception& e) {
+        cout << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}